@@ -0,0 +1,127 @@
+#include "ofApp.h"
+
+//--------------------------------------------------------------
+ofApp::ofApp(int argc, char* argv[]){
+    parse(argc, argv);
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+
+    if (!reader.open(log_path))
+    {
+        ofLogError("could not open capture") << log_path;
+        ofExit(1);
+        return;
+    }
+
+    cout << "replay : " << log_path << " (" << reader.size() << " bytes), "
+         << (b_controller ? "controller" : "parser") << ", "
+         << (b_recorded_speed ? "recorded" : "max") << " speed, " << repeat << " times" << endl;
+
+    if (b_controller) replayController();
+    else replayParser();
+
+    ofExit();
+}
+
+//--------------------------------------------------------------
+void ofApp::replayParser(){
+
+    ofxOriental::Parser parser;
+    ofxOriental::CaptureReader::Record r;
+    size_t frames = 0;
+    size_t bytes = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat; ++i)
+    {
+        reader.rewind();
+        origin = std::chrono::steady_clock::now();
+        while (reader.next(r))
+        {
+            if (r.dir != ofxOriental::Direction::Rx) continue;
+            wait(r.time_ns);
+            parser.feed(r.data, r.size);
+            bytes += r.size;
+            while (parser.available())
+            {
+                parser.pop();
+                ++frames;
+            }
+        }
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    cout << "frames      : " << frames << endl;
+    cout << "crc errors  : " << parser.getNumCrcErrors() << endl;
+    cout << "rx bytes    : " << bytes << endl;
+    cout << "elapsed     : " << sec << " sec" << endl;
+    cout << "throughput  : " << (frames / sec) << " frames/sec, " << (bytes / sec / 1e6) << " MB/sec" << endl;
+}
+
+//--------------------------------------------------------------
+void ofApp::replayController(){
+
+    ofxOriental::Controller<replay_max_motors> modbus;
+    modbus.beginReplay();
+
+    ofxOriental::CaptureReader::Record r;
+    size_t records = 0;
+    std::set<uint8_t> ids; // motors which have been asked for something
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat; ++i)
+    {
+        reader.rewind();
+        origin = std::chrono::steady_clock::now();
+        while (reader.next(r))
+        {
+            wait(r.time_ns);
+            if (r.dir == ofxOriental::Direction::Tx && r.size == 8) ids.insert(r.data[0]);
+            modbus.replay(r.dir, r.data, r.size);
+            modbus.update();
+            ++records;
+        }
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    cout << "records     : " << records << endl;
+    cout << "responses   : " << modbus.getNumResponses() << endl;
+    cout << "timeouts    : " << modbus.getNumTimeouts() << endl;
+    cout << "crc errors  : " << modbus.getNumCrcErrors() << endl;
+    cout << "elapsed     : " << sec << " sec" << endl;
+    cout << "throughput  : " << (records / sec) << " records/sec" << endl;
+    cout << endl;
+    cout << "[last decoded state]" << endl;
+    for (auto i : ids)
+    {
+        if (i == 0 || i > modbus.getNumMotors()) continue;
+        auto s = modbus.getStatus(i);
+        cout << "motor " << (int)i << " : pos " << modbus.getPosition(i)
+             << ", ready " << s.ready << ", alarm " << s.alarm << ", move " << s.move << endl;
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::wait(uint64_t time_ns){
+
+    if (!b_recorded_speed) return;
+    std::this_thread::sleep_until(origin + std::chrono::nanoseconds(time_ns));
+}
+
+//--------------------------------------------------------------
+void ofApp::parse(int argc, char* argv[]){
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string key = argv[i];
+        string val = argv[i + 1];
+
+        if      (key == "--log")    log_path = val;
+        else if (key == "--mode")   b_controller = (val != "parser");
+        else if (key == "--speed")  b_recorded_speed = (val == "recorded");
+        else if (key == "--repeat") repeat = std::max(1, ofToInt(val));
+        else ofLogError("unknown option") << key;
+    }
+}
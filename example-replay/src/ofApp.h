@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxModbusOriental.h"
+
+// replays a bus capture written by Controller::startCapture()
+//
+// usage : example-replay --log PATH [options]
+//   --mode parser|controller   decode with Parser only, or drive a Controller (default: controller)
+//   --speed recorded|max       keep recorded timing or run as fast as possible (default: max)
+//   --repeat N                 replay the log N times, useful as a benchmark corpus (default: 1)
+
+static const size_t replay_max_motors = 59;
+
+class ofApp : public ofBaseApp{
+
+	public:
+		ofApp(int argc, char* argv[]);
+
+		void setup();
+
+	private:
+
+		void parse(int argc, char* argv[]);
+		void replayParser();
+		void replayController();
+		void wait(uint64_t time_ns);
+
+		string log_path;
+		bool b_controller {true};
+		bool b_recorded_speed {false};
+		size_t repeat {1};
+
+		ofxOriental::CaptureReader reader;
+		std::chrono::steady_clock::time_point origin;
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "ofxModbusOriental.h"
+
+// pty-backed emulation of a bus of oriental drives.
+// Controller opens the slave side (getPortName()) like a usb serial port,
+// and this class answers on the master side from its own thread.
+// openTcp() serves the same drives as a local RTU-over-TCP gateway instead.
+class EmulatedBus
+{
+    // up to the operation data of data No.255
+    static constexpr size_t num_regs = 0x1800 + 256 * 0x40;
+
+    struct Drive
+    {
+        std::array<uint16_t, num_regs> reg {};
+        std::array<bool, 256> uploaded {};
+        double pos {0.0};
+        double target {0.0};
+        double vel {0.0};
+        bool moving {false};
+        uint16_t prev_io {0};
+    };
+
+public:
+
+    ~EmulatedBus() { close(); }
+
+    bool open(size_t num_drives, size_t baud, float response_delay_sec)
+    {
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0) return false;
+        if (grantpt(fd) != 0 || unlockpt(fd) != 0) { ::close(fd); fd = -1; return false; }
+
+        termios tio;
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+
+        port_name = ptsname(fd);
+        return start(num_drives, baud, response_delay_sec);
+    }
+
+    // the same drives behind a local RTU-over-TCP stand-in of an Ethernet to RS-485 gateway,
+    // listening on 127.0.0.1:getTcpPort() for one client at a time
+    bool openTcp(size_t num_drives, size_t baud, float response_delay_sec)
+    {
+        listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0) return false;
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        if (::bind(listen_fd, (sockaddr*)&addr, len) != 0 || ::listen(listen_fd, 1) != 0 ||
+            getsockname(listen_fd, (sockaddr*)&addr, &len) != 0)
+        {
+            ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        tcp_port = ntohs(addr.sin_port);
+        port_name = "127.0.0.1:" + std::to_string(tcp_port);
+        return start(num_drives, baud, response_delay_sec);
+    }
+
+    void close()
+    {
+        b_running = false;
+        if (th.joinable()) th.join();
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        if (listen_fd >= 0) ::close(listen_fd);
+        listen_fd = -1;
+    }
+
+    const std::string& getPortName() const { return port_name; }
+    uint16_t getTcpPort() const { return tcp_port; }
+
+    size_t getNumFrames() const { return num_frames; }
+    size_t getNumCrcErrors() const { return num_crc_errors; }
+
+private:
+
+    bool start(size_t num_drives, size_t baud, float response_delay_sec)
+    {
+        drives.assign(num_drives + 1, Drive());
+        for (auto& drv : drives) drv.reg[0x0030] = drv.reg[0x0031] = 0xFFFF; // no group address
+        this->baud = baud;
+        this->response_delay = response_delay_sec;
+        b_running = true;
+        th = std::thread(&EmulatedBus::run, this);
+        return true;
+    }
+
+    void run()
+    {
+        std::vector<uint8_t> rx;
+        uint8_t buf[256];
+        auto prev = std::chrono::steady_clock::now();
+
+        while (b_running)
+        {
+            if (fd < 0 && listen_fd >= 0)
+            {
+                pollfd lfd { listen_fd, POLLIN, 0 };
+                if (::poll(&lfd, 1, 1) > 0) fd = ::accept(listen_fd, nullptr, nullptr);
+                if (fd >= 0)
+                {
+                    int one = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                }
+                rx.clear();
+                continue;
+            }
+
+            pollfd pfd { fd, POLLIN, 0 };
+            if (::poll(&pfd, 1, 1) > 0 && (pfd.revents & (POLLIN | POLLHUP)))
+            {
+                ssize_t n = ::read(fd, buf, sizeof(buf));
+                if (n > 0) rx.insert(rx.end(), buf, buf + n);
+                else if (n == 0 && listen_fd >= 0)
+                {
+                    // client gone, wait for the next one
+                    ::close(fd);
+                    fd = -1;
+                    continue;
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            simulate(std::chrono::duration<double>(now - prev).count());
+            prev = now;
+
+            size_t len = 0;
+            while ((len = frameLength(rx)) && rx.size() >= len)
+            {
+                if (len < 4 || crc.get(rx.data(), len - 2) != (uint16_t)(rx[len - 2] | (rx[len - 1] << 8)))
+                {
+                    // resync byte by byte like a real slave waiting for silence
+                    ++num_crc_errors;
+                    rx.erase(rx.begin());
+                    continue;
+                }
+                ++num_frames;
+                handleFrame(rx.data(), len);
+                rx.erase(rx.begin(), rx.begin() + len);
+            }
+        }
+    }
+
+    size_t frameLength(const std::vector<uint8_t>& rx)
+    {
+        if (rx.size() < 2) return 0;
+        switch (rx[1])
+        {
+            case 0x03: return 8;
+            case 0x10: return (rx.size() < 7) ? 0 : 9 + rx[6];
+            default:   return 1; // unknown function, dropped as a broken frame
+        }
+    }
+
+    // drives which take a frame to id : all for broadcast, the drive itself,
+    // or the drives whose group address (0x0030) is id. only a drive of its own answers
+    std::vector<size_t> recipients(uint8_t id)
+    {
+        std::vector<size_t> ds;
+        for (size_t d = 1; d < drives.size(); ++d)
+            if (id == 0 || d == id || reg32(d, 0x0030) == id) ds.push_back(d);
+        return ds;
+    }
+
+    void handleFrame(const uint8_t* f, size_t len)
+    {
+        uint8_t id = f[0];
+        uint16_t addr = (f[2] << 8) | f[3];
+        uint16_t count = (f[4] << 8) | f[5];
+        bool b_unicast = id != 0 && id < drives.size();
+
+        if (f[1] == 0x10)
+        {
+            // no more registers than the frame carries
+            count = std::min<size_t>({ count, (size_t)f[6] / 2, (len - 9) / 2 });
+            for (size_t d : recipients(id))
+            {
+                for (size_t i = 0; i < count && addr + i < num_regs; ++i)
+                    drives[d].reg[addr + i] = (f[7 + 2 * i] << 8) | f[8 + 2 * i];
+                apply(d, addr, count);
+            }
+            if (!b_unicast) return;
+            std::vector<uint8_t> res(f, f + 6);
+            reply(res);
+        }
+        else if (f[1] == 0x03)
+        {
+            if (!b_unicast || count > 125) return;
+            refresh(id);
+            std::vector<uint8_t> res { id, 0x03, (uint8_t)(count * 2) };
+            for (size_t i = 0; i < count && addr + i < num_regs; ++i)
+            {
+                res.push_back(drives[id].reg[addr + i] >> 8);
+                res.push_back(drives[id].reg[addr + i] & 0xFF);
+            }
+            reply(res);
+        }
+    }
+
+    void reply(std::vector<uint8_t>& res)
+    {
+        uint16_t c = crc.get(res.data(), res.size());
+        res.push_back(c & 0xFF);
+        res.push_back(c >> 8);
+
+        // drive processing time + time on the wire (8E2 = 12 bits per char)
+        double wire = (double)res.size() * 12.0 / (double)baud;
+        std::this_thread::sleep_for(std::chrono::duration<double>(response_delay + wire));
+        if (listen_fd >= 0) ::send(fd, res.data(), res.size(), MSG_NOSIGNAL);
+        else ::write(fd, res.data(), res.size());
+    }
+
+    int32_t reg32(size_t d, uint16_t addr)
+    {
+        return (int32_t)(((uint32_t)drives[d].reg[addr] << 16) | drives[d].reg[addr + 1]);
+    }
+
+    void apply(size_t d, uint16_t addr, uint16_t count)
+    {
+        Drive& drv = drives[d];
+        auto touches = [&](uint16_t r) { return addr <= r && r < addr + count; };
+
+        // direct data operation: trigger register
+        if (touches(0x0058 + 14) && reg32(d, 0x0058 + 14) != 0)
+            move(d, reg32(d, 0x0058 + 4), reg32(d, 0x0058 + 6));
+
+        if (addr >= 0x1800 && addr < num_regs) drv.uploaded[(addr - 0x1800) / 0x40] = true;
+
+        // remote io: rising edges of start / stop
+        if (touches(0x007D))
+        {
+            uint16_t io = drv.reg[0x007D];
+            uint16_t rise = io & ~drv.prev_io;
+            if (rise & 0x0008)
+            {
+                // selected data number runs its operation data when one was uploaded, else the concurrent slot
+                uint8_t no = drv.reg[0x007B] & 0xFF;
+                uint16_t op = 0x1800 + no * 0x40;
+                if (drv.uploaded[no]) move(d, reg32(d, op + 2), reg32(d, op + 4));
+                else
+                {
+                    // share slot of the drive : its place in its group of 59
+                    size_t slot = (d - 1) % 59 + 1;
+                    move(d, reg32(d, 0x0400 + 2 * slot), reg32(d, 0x0480 + 2 * slot));
+                }
+            }
+            if (rise & 0x0020) drv.moving = false;
+            drv.prev_io = io;
+        }
+    }
+
+    void move(size_t d, int32_t target, int32_t vel)
+    {
+        Drive& drv = drives[d];
+        drv.target = target;
+        drv.vel = std::abs(vel) ? std::abs(vel) : 1000.0;
+        drv.moving = true;
+    }
+
+    void simulate(double dt)
+    {
+        for (auto& drv : drives)
+        {
+            if (!drv.moving) continue;
+            double step = drv.vel * dt;
+            double diff = drv.target - drv.pos;
+            if (std::abs(diff) <= step) { drv.pos = drv.target; drv.moving = false; }
+            else drv.pos += (diff > 0) ? step : -step;
+        }
+    }
+
+    void refresh(size_t d)
+    {
+        Drive& drv = drives[d];
+        uint32_t p = (uint32_t)(int32_t)drv.pos;
+        drv.reg[0x0120] = p >> 16;
+        drv.reg[0x0121] = p & 0xFFFF;
+        drv.reg[0x007E] = 0x0000;
+        drv.reg[0x007F] = drv.moving ? 0x2100 : 0x0020;
+    }
+
+    int fd {-1};
+    int listen_fd {-1};
+    uint16_t tcp_port {0};
+    std::string port_name;
+    std::thread th;
+    std::atomic<bool> b_running {false};
+    std::atomic<size_t> num_frames {0};
+    std::atomic<size_t> num_crc_errors {0};
+
+    std::vector<Drive> drives;
+    size_t baud {230400};
+    double response_delay {0.002};
+    ofxOriental::CrcGenerator crc;
+};
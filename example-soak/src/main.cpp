@@ -0,0 +1,13 @@
+#include "ofMain.h"
+#include "ofAppNoWindow.h"
+#include "ofApp.h"
+
+//========================================================================
+int main(int argc, char* argv[]){
+	ofAppNoWindow window;
+	ofSetupOpenGL(&window, 0, 0, OF_WINDOW);	// headless, no GL context
+
+	// all soak settings come from the command line, see ofApp.h
+	ofRunApp(new ofApp(argc, argv));
+
+}
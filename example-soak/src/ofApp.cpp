@@ -0,0 +1,269 @@
+#include "ofApp.h"
+
+//--------------------------------------------------------------
+ofApp::ofApp(int argc, char* argv[]){
+    parse(argc, argv);
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+
+    ofSetFrameRate(0);
+
+    string port = settings.port;
+    string tcp = settings.tcp;
+    if (port.empty() && tcp.empty())
+    {
+        bool b_tcp = (settings.emulate == "tcp");
+        float delay = settings.delay_ms * 0.001f;
+        if (!(b_tcp ? bus.openTcp(settings.motors, settings.baud, delay) : bus.open(settings.motors, settings.baud, delay)))
+        {
+            ofLogError("could not open emulated bus");
+            ofExit(1);
+            return;
+        }
+        (b_tcp ? tcp : port) = bus.getPortName();
+    }
+
+    cout << "soak : " << settings.motors << " motors on " << (tcp.empty() ? port : tcp) << " @ " << settings.baud
+         << ", interval " << settings.interval << " sec, " << settings.rate << " cmd/sec, "
+         << settings.hours << " hours" << endl;
+    if (tcp.empty())
+    {
+        modbus.begin(port, settings.baud, settings.interval);
+    }
+    else
+    {
+        size_t colon = tcp.rfind(':');
+        string host = tcp.substr(0, colon);
+        uint16_t tcp_port = (colon == string::npos) ? 502 : ofToInt(tcp.substr(colon + 1));
+        modbus.begin(std::make_shared<ofxOriental::TcpPort>(host, tcp_port), settings.interval);
+    }
+    if (!settings.capture.empty()) modbus.startCapture(ofToDataPath(settings.capture));
+
+    csv.open(ofToDataPath(settings.csv));
+    csv << "elapsed_sec,tps,writes_per_sec,tx_slot_usage,responses,timeouts,errors,"
+        << "lat_p50_ms,lat_p90_ms,lat_p99_ms,lat_max_ms,queries,requests,max_queries,max_requests,rss_kb,"
+        << "emu_frames,emu_crc_errors" << endl;
+
+    start_time = prev_update = prev_report = ofxOriental::nowNanos();
+}
+
+//--------------------------------------------------------------
+void ofApp::update(){
+
+    ofxOriental::Nanos now = ofxOriental::nowNanos();
+
+    // open loop load : commands are offered at a fixed rate whether or not the bus keeps up
+    offered += ofxOriental::toSec(now - prev_update) * settings.rate;
+    prev_update = now;
+    while (offered >= 1.0)
+    {
+        issue(pick());
+        offered -= 1.0;
+    }
+
+    // requests are counted by their own Handle, in track()
+    modbus.update();
+
+    max_queries = std::max(max_queries, modbus.query_size());
+    max_requests = std::max(max_requests, modbus.request_size());
+
+    now = ofxOriental::nowNanos();
+    if (ofxOriental::toSec(now - prev_report) >= settings.report) report(now);
+    if (ofxOriental::toSec(now - start_time) >= settings.hours * 3600.0) ofExit();
+}
+
+//--------------------------------------------------------------
+void ofApp::exit(){
+    report(ofxOriental::nowNanos());
+    csv.close();
+    modbus.stopCapture();
+    bus.close();
+}
+
+//--------------------------------------------------------------
+void ofApp::issue(Cmd cmd){
+
+    uint8_t id = next_id;
+    if (++next_id > settings.motors) next_id = 1;
+
+    switch (cmd)
+    {
+        case Cmd::Status:
+        {
+            track(modbus.request(ofxOriental::RequestType::Status, id));
+            break;
+        }
+        case Cmd::Position:
+        {
+            track(modbus.request(ofxOriental::RequestType::Position, id));
+            break;
+        }
+        case Cmd::Direct:
+        {
+            int32_t pos = (int32_t)ofRandom(-10000, 10000);
+            modbus.direct(id, pos, 5000, 5000, 5000);
+            break;
+        }
+        case Cmd::Buffer:
+        {
+            for (size_t i = 1; i <= settings.motors; ++i)
+                modbus.setPosition(i, (int32_t)ofRandom(-10000, 10000));
+            modbus.setVelocity(0, 5000);
+            modbus.writePosition(0);
+            modbus.writeVelocity(0);
+            modbus.start(0);
+            modbus.clear(0);
+            break;
+        }
+        case Cmd::Stop:
+        {
+            modbus.stop(id);
+            break;
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::track(ofxOriental::Handle h){
+
+    // resolved on the update() thread, latency from issue to the decoded reply
+    ofxOriental::Nanos issued = ofxOriental::nowNanos();
+    h.then([this, issued](const ofxOriental::Result& r)
+    {
+        switch (r.status)
+        {
+            case ofxOriental::Result::Status::Done:
+                latencies.push_back(ofxOriental::nowNanos() - issued);
+                ++period_responses;
+                break;
+            case ofxOriental::Result::Status::Timeout:
+                ++period_timeouts;
+                break;
+            default:
+                ++period_errors;
+                break;
+        }
+    });
+}
+
+//--------------------------------------------------------------
+ofApp::Cmd ofApp::pick(){
+
+    float total = 0.f;
+    for (auto& m : settings.mix) total += m.second;
+    float r = ofRandom(total);
+    for (auto& m : settings.mix)
+    {
+        if (r < m.second) return m.first;
+        r -= m.second;
+    }
+    return Cmd::Status;
+}
+
+//--------------------------------------------------------------
+void ofApp::report(ofxOriental::Nanos now){
+
+    float period = (float)ofxOriental::toSec(now - prev_report);
+    if (period <= 0.f) return;
+
+    size_t writes = modbus.getNumWrites();
+    float writes_per_sec = (writes - prev_writes) / period;
+
+    // the transmitter gets at most one slot per interval, so usage above 1.0 never happens
+    // and a steady drop under full load points to Ticker drift
+    float slot_usage = writes_per_sec * settings.interval;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](float p) -> float
+    {
+        if (latencies.empty()) return 0.f;
+        size_t i = std::min(latencies.size() - 1, (size_t)(p * latencies.size()));
+        return (float)(latencies[i] * 1e-6);
+    };
+
+    stringstream ss;
+    ss << ofxOriental::toSec(now - start_time) << ","
+       << (period_responses / period) << ","
+       << writes_per_sec << ","
+       << slot_usage << ","
+       << period_responses << ","
+       << period_timeouts << ","
+       << period_errors << ","
+       << percentile(0.5f) << ","
+       << percentile(0.9f) << ","
+       << percentile(0.99f) << ","
+       << percentile(1.f) << ","
+       << modbus.query_size() << ","
+       << modbus.request_size() << ","
+       << max_queries << ","
+       << max_requests << ","
+       << residentBytes() / 1024 << ","
+       << bus.getNumFrames() << ","
+       << bus.getNumCrcErrors();
+
+    cout << ss.str() << endl;
+    csv << ss.str() << endl;
+
+    latencies.clear();
+    prev_writes = writes;
+    period_responses = period_timeouts = period_errors = 0;
+    max_queries = max_requests = 0;
+    prev_report = now;
+}
+
+//--------------------------------------------------------------
+size_t ofApp::residentBytes(){
+
+    // linux only, resident pages are the second field of statm
+    ifstream statm("/proc/self/statm");
+    size_t total = 0, resident = 0;
+    statm >> total >> resident;
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+//--------------------------------------------------------------
+void ofApp::parse(int argc, char* argv[]){
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string key = argv[i];
+        string val = argv[i + 1];
+
+        if      (key == "--port")     settings.port = val;
+        else if (key == "--tcp")      settings.tcp = val;
+        else if (key == "--emulate")  settings.emulate = val;
+        else if (key == "--motors")   settings.motors = ofClamp(ofToInt(val), 1, soak_max_motors);
+        else if (key == "--baud")     settings.baud = ofToInt(val);
+        else if (key == "--interval") settings.interval = ofToFloat(val);
+        else if (key == "--rate")     settings.rate = ofToFloat(val);
+        else if (key == "--hours")    settings.hours = ofToFloat(val);
+        else if (key == "--report")   settings.report = ofToFloat(val);
+        else if (key == "--delay")    settings.delay_ms = ofToFloat(val);
+        else if (key == "--csv")      settings.csv = val;
+        else if (key == "--capture")  settings.capture = val;
+        else if (key == "--mix")
+        {
+            static const map<string, Cmd> names {
+                {"status", Cmd::Status}, {"position", Cmd::Position},
+                {"direct", Cmd::Direct}, {"buffer", Cmd::Buffer}, {"stop", Cmd::Stop}
+            };
+            for (auto& m : settings.mix) m.second = 0.f;
+            for (auto& item : ofSplitString(val, ","))
+            {
+                auto kv = ofSplitString(item, "=");
+                if (kv.size() != 2 || !names.count(kv[0]))
+                {
+                    ofLogError("unknown mix entry") << item;
+                    continue;
+                }
+                for (auto& m : settings.mix)
+                    if (m.first == names.at(kv[0])) m.second = ofToFloat(kv[1]);
+            }
+        }
+        else ofLogError("unknown option") << key;
+    }
+
+    if (settings.rate <= 0.f) settings.rate = 1.f / settings.interval;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxModbusOriental.h"
+#include "EmulatedBus.h"
+
+// long running load generator for ofxModbusOriental
+//
+// usage : example-soak [options]
+//   --port NAME      real serial port (default: pty-backed emulated drives)
+//   --tcp HOST:PORT  RTU-over-TCP gateway instead of a serial port
+//   --emulate KIND   emulated drives behind a pty or a local TCP gateway : pty | tcp (default: pty)
+//   --motors N       number of motors, 1 - 59 (default: 8)
+//   --baud B         baud rate (default: 230400)
+//   --interval SEC   modbus transmit interval (default: 0.05)
+//   --rate N         offered commands per second (default: 1 / interval)
+//   --mix LIST       command weights, e.g. status=4,position=4,direct=1,buffer=1,stop=0
+//   --hours H        soak duration (default: 1)
+//   --report SEC     report period (default: 10)
+//   --delay MS       emulated drive response delay (default: 2)
+//   --csv PATH       report file (default: soak.csv in data folder)
+//   --capture PATH   record the bus traffic for example-replay (default: off)
+
+static const size_t soak_max_motors = 59;
+
+class ofApp : public ofBaseApp{
+
+	public:
+		ofApp(int argc, char* argv[]);
+
+		void setup();
+		void update();
+		void exit();
+
+	private:
+
+		enum class Cmd { Status, Position, Direct, Buffer, Stop };
+
+		struct Settings
+		{
+			string port;
+			string tcp;
+			string emulate {"pty"};
+			size_t motors {8};
+			size_t baud {230400};
+			float interval {0.05f};
+			float rate {0.f};
+			float hours {1.f};
+			float report {10.f};
+			float delay_ms {2.f};
+			string csv {"soak.csv"};
+			string capture;
+			vector<pair<Cmd, float>> mix {
+				{Cmd::Status, 4.f}, {Cmd::Position, 4.f}, {Cmd::Direct, 1.f}, {Cmd::Buffer, 1.f}, {Cmd::Stop, 0.f}
+			};
+		};
+
+		void parse(int argc, char* argv[]);
+		void issue(Cmd cmd);
+		void track(ofxOriental::Handle h);
+		Cmd pick();
+		void report(ofxOriental::Nanos now);
+		size_t residentBytes();
+
+		Settings settings;
+		EmulatedBus bus;
+		ofxOriental::Controller<soak_max_motors> modbus;
+		ofstream csv;
+
+		// steady_clock [ns] : a float of seconds since start is down to ms after hours
+		ofxOriental::Nanos start_time {0};
+		ofxOriental::Nanos prev_update {0};
+		ofxOriental::Nanos prev_report {0};
+		double offered {0.0};
+		uint8_t next_id {1};
+
+		vector<ofxOriental::Nanos> latencies;	// completed request latencies in this report period
+		size_t prev_writes {0};
+		size_t period_responses {0};
+		size_t period_timeouts {0};
+		size_t period_errors {0};		// exceptions, write errors, malformed replies, cancels
+		size_t max_queries {0};
+		size_t max_requests {0};
+};
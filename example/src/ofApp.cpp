@@ -20,13 +20,16 @@ void ofApp::setup(){
     
     cout << "begin modbus communication" << endl;
     modbus.begin(0, modbus_baud, modbus_interval);
+    // start from the last tuned interval and keep tuning it to this bus
+    modbus.setAutoInterval(true, ofToDataPath("modbus_interval.txt"));
     
     cout << "read current motor position" << endl;
+    vector<ofxOriental::Handle> replies;
     for (size_t i = 1; i <= modbus.getNumMotors(); ++i)
-        modbus.request(ofxOriental::RequestType::Position, i);
+        replies.push_back(modbus.request(ofxOriental::RequestType::Position, i));
     
     cout << "write all queries & request, and wait for the reply..." << endl;
-    while (!modbus.empty()) modbus.update();
+    if (!modbus.wait(replies, 5.f)) ofLogError("position request timeout");
     
     cout << "set initial settings to buffers" << endl;
     // 0: broadcast, 1-N: motor id
@@ -48,11 +51,12 @@ void ofApp::setup(){
     modbus.write(0);
     
     cout << "send status request" << endl;
+    replies.clear();
     for (size_t i = 1; i <= modbus.getNumMotors(); ++i)
-        modbus.request(ofxOriental::RequestType::Status, i);
+        replies.push_back(modbus.request(ofxOriental::RequestType::Status, i));
     
     cout << "write all queries & request, and wait for the reply..." << endl;
-    while (!modbus.empty()) modbus.update();
+    if (!modbus.wait(replies, 5.f)) ofLogError("status request timeout");
     
     cout << "check if motor status is ready " << endl;
     if (!modbus.ready()) ofLogError("motor is NOT ready");
@@ -1,17 +1,19 @@
 #ifndef OFXMODBUSORIENTAL_BUFFER_H
 #define OFXMODBUSORIENTAL_BUFFER_H
 
+#include <array>
 #include "Query.h"
 
 OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
 
-class ConcurrentValue : public QueryImpl<255>
+class ConcurrentValue : public FixedFrame<writeFrameSize(0x7B)>
 {
-    const uint8_t max_drive_no_size = 59;
-    const uint8_t reg_size = 4;
-    
 public:
     
+    static constexpr uint8_t max_drive_no_size = 59;
+    static constexpr uint8_t reg_size = 4;
+    static_assert(val_offset + reg_size * (max_drive_no_size + 1) + 2 <= writeFrameSize(0x7B), "slots overlap the crc");
+    
     ConcurrentValue()  {}
     ~ConcurrentValue() {}
     
@@ -25,11 +27,7 @@ class ConcurrentPosition : public ConcurrentValue
 public:
     ConcurrentPosition()
     {
-        setID(0x00);
-        setFunc(0x10);
-        setAddr(0x0400);
-        setRegSize(0x7B);
-        setRegBytes(0x7B * 2);
+        setWrite<reg::ConcurrentPosition>(0x00);
     }
 };
 
@@ -38,11 +36,7 @@ class ConcurrentVelocity : public ConcurrentValue
 public:
     ConcurrentVelocity()
     {
-        setID(0x00);
-        setFunc(0x10);
-        setAddr(0x0480);
-        setRegSize(0x7B);
-        setRegBytes(0x7B * 2);
+        setWrite<reg::ConcurrentVelocity>(0x00);
     }
 };
 
@@ -51,11 +45,7 @@ class ConcurrentMode : public ConcurrentValue
 public:
     ConcurrentMode()
     {
-        setID(0x00);
-        setFunc(0x10);
-        setAddr(0x0500);
-        setRegSize(0x7B);
-        setRegBytes(0x7B * 2);
+        setWrite<reg::ConcurrentMode>(0x00);
     }
 };
 
@@ -64,11 +54,7 @@ class ConcurrentAcceleration : public ConcurrentValue
 public:
     ConcurrentAcceleration()
     {
-        setID(0x00);
-        setFunc(0x10);
-        setAddr(0x0600);
-        setRegSize(0x7B);
-        setRegBytes(0x7B * 2);
+        setWrite<reg::ConcurrentAcc>(0x00);
     }
 };
 
@@ -77,11 +63,7 @@ class ConcurrentDeceleration : public ConcurrentValue
 public:
     ConcurrentDeceleration()
     {
-        setID(0x00);
-        setFunc(0x10);
-        setAddr(0x0680);
-        setRegSize(0x7B);
-        setRegBytes(0x7B * 2);
+        setWrite<reg::ConcurrentDec>(0x00);
     }
 };
 
@@ -90,64 +72,110 @@ class ConcurrentCurrent : public ConcurrentValue
 public:
     ConcurrentCurrent()
     {
-        setID(0x00);
-        setFunc(0x10);
-        setAddr(0x0700);
-        setRegSize(0x7B);
-        setRegBytes(0x7B * 2);
+        setWrite<reg::ConcurrentCurrent>(0x00);
     }
 };
 
 
 class Buffer
 {
-	std::shared_ptr<ConcurrentPosition> pos;
-	std::shared_ptr<ConcurrentVelocity> vel;
-	std::shared_ptr<ConcurrentMode> mode;
-	std::shared_ptr<ConcurrentAcceleration> acc;
-	std::shared_ptr<ConcurrentDeceleration> dec;
-	std::shared_ptr<ConcurrentCurrent> crnt;
+	ConcurrentPosition pos;
+	ConcurrentVelocity vel;
+	ConcurrentMode mode;
+	ConcurrentAcceleration acc;
+	ConcurrentDeceleration dec;
+	ConcurrentCurrent crnt;
 	
     enum class State { Idle, Pos, Vel, Start, Clear };
     State state { State::Idle };
 
 public:
     
-    Buffer()
+    // the frame of one register block as it is now, to id
+    using FrameOf = Frame (Buffer::*)(uint8_t) const;
+    
+    void setPosition(uint8_t id, int32_t p) { pos.set(id, (uint32_t)p); }
+    void setVelocity(uint8_t id, int32_t v) { vel.set(id, (uint32_t)v); }
+    void setMode(uint8_t id, uint8_t m) { mode.set(id, m); }
+    void setAcceleration(uint8_t id, uint32_t a) { acc.set(id, a); }
+    void setDeceleration(uint8_t id, uint32_t d) { dec.set(id, d); }
+    void setCurrent(uint8_t id, uint32_t c) { crnt.set(id, c); }
+    
+    Frame getPositionFrame(uint8_t id) const { return pos.frame(id); }
+	Frame getVelocityFrame(uint8_t id) const { return vel.frame(id); }
+	Frame getModeFrame(uint8_t id) const { return mode.frame(id); }
+	Frame getAccelerationFrame(uint8_t id) const { return acc.frame(id); }
+	Frame getDecelerationFrame(uint8_t id) const { return dec.frame(id); }
+	Frame getCurrentFrame(uint8_t id) const { return crnt.frame(id); }
+    
+    int32_t getPosition(uint8_t id) const { return (int32_t)pos.at(id); }
+	int32_t getVelocity(uint8_t id) const { return (int32_t)vel.at(id); }
+	uint8_t getMode(uint8_t id) const { return (uint8_t)mode.at(id); }
+	uint32_t getAcceleration(uint8_t id) const { return acc.at(id); }
+	uint32_t getDeceleration(uint8_t id) const { return dec.at(id); }
+	uint32_t getCurrent(uint8_t id) const { return crnt.at(id); }
+    
+    size_t size() { return pos.getDriveNoSize(); }
+	
+};
+
+
+// Buffers for more axes than one concurrent frame holds.
+// motor id is split into groups of slots_per_group : group (id - 1) / slots_per_group,
+// slot (id - 1) % slots_per_group + 1. each drive's share slot must be set to its slot, and each
+// group needs its own drive group address (id 0 of every group would collide), until then
+// frames to every axis are refused.
+template <size_t Size>
+class BufferGroups
+{
+public:
+    
+    static constexpr size_t slots_per_group = 59;
+    static constexpr size_t num_groups = (Size + slots_per_group - 1) / slots_per_group;
+    
+    BufferGroups() { addrs.fill(0); }
+    
+    static size_t groupOf(uint8_t id) { return (id == 0) ? 0 : (id - 1) / slots_per_group; }
+    static uint8_t slotOf(uint8_t id) { return (id == 0) ? 0 : (id - 1) % slots_per_group + 1; }
+    
+    size_t size() const { return num_groups; }
+    Buffer& group(size_t g) { return buffers[g]; }
+    
+    // where the frames of group g go when every axis is written (id 0)
+    void setAddress(size_t g, uint8_t addr) { if (g < num_groups) addrs[g] = addr; }
+    uint8_t getAddress(size_t g) const { return addrs[g]; }
+    
+    // one group, or every group has its own non broadcast address
+    static bool distinct(const std::array<uint8_t, num_groups>& a)
     {
-        pos = std::make_shared<ConcurrentPosition>();
-        vel = std::make_shared<ConcurrentVelocity>();
-        mode = std::make_shared<ConcurrentMode>();
-        acc = std::make_shared<ConcurrentAcceleration>();
-        dec = std::make_shared<ConcurrentDeceleration>();
-        crnt = std::make_shared<ConcurrentCurrent>();
+        if (num_groups == 1) return true;
+        for (size_t g = 0; g < num_groups; ++g)
+        {
+            if (a[g] == 0) return false;
+            for (size_t h = 0; h < g; ++h) if (a[h] == a[g]) return false;
+        }
+        return true;
     }
+    bool addressed() const { return distinct(addrs); }
     
-    using DataRef = std::shared_ptr<Query>;
-    
-    void setPosition(uint8_t id, int32_t p) { pos->set(id, (uint32_t)p); }
-    void setVelocity(uint8_t id, int32_t v) { vel->set(id, (uint32_t)v); }
-    void setMode(uint8_t id, uint8_t m) { mode->set(id, m); }
-    void setAcceleration(uint8_t id, uint32_t a) { acc->set(id, a); }
-    void setDeceleration(uint8_t id, uint32_t d) { dec->set(id, d); }
-    void setCurrent(uint8_t id, uint32_t c) { crnt->set(id, c); }
-    
-    DataRef getPositionRef() { return pos; }
-	DataRef getVelocityRef() { return vel; }
-	DataRef getModeRef() { return mode; }
-	DataRef getAccelerationRef() { return acc; }
-	DataRef getDecelerationRef() { return dec; }
-	DataRef getCurrentRef() { return crnt; }
-    
-    int32_t getPosition(uint8_t id) { return (int32_t)pos->at(id); }
-	int32_t getVelocity(uint8_t id) { return (int32_t)vel->at(id); }
-	uint8_t getMode(uint8_t id) { return (uint8_t)mode->at(id); }
-	uint32_t getAcceleration(uint8_t id) { return acc->at(id); }
-	uint32_t getDeceleration(uint8_t id) { return dec->at(id); }
-	uint32_t getCurrent(uint8_t id) { return crnt->at(id); }
-    
-    size_t size() { return pos->getDriveNoSize(); }
-	
+    void setPosition(uint8_t id, int32_t p) { buffers[groupOf(id)].setPosition(slotOf(id), p); }
+    void setVelocity(uint8_t id, int32_t v) { buffers[groupOf(id)].setVelocity(slotOf(id), v); }
+    void setMode(uint8_t id, uint8_t m) { buffers[groupOf(id)].setMode(slotOf(id), m); }
+    void setAcceleration(uint8_t id, uint32_t a) { buffers[groupOf(id)].setAcceleration(slotOf(id), a); }
+    void setDeceleration(uint8_t id, uint32_t d) { buffers[groupOf(id)].setDeceleration(slotOf(id), d); }
+    void setCurrent(uint8_t id, uint32_t c) { buffers[groupOf(id)].setCurrent(slotOf(id), c); }
+    
+    int32_t getPosition(uint8_t id) { return buffers[groupOf(id)].getPosition(slotOf(id)); }
+    int32_t getVelocity(uint8_t id) { return buffers[groupOf(id)].getVelocity(slotOf(id)); }
+    uint8_t getMode(uint8_t id) { return buffers[groupOf(id)].getMode(slotOf(id)); }
+    uint32_t getAcceleration(uint8_t id) { return buffers[groupOf(id)].getAcceleration(slotOf(id)); }
+    uint32_t getDeceleration(uint8_t id) { return buffers[groupOf(id)].getDeceleration(slotOf(id)); }
+    uint32_t getCurrent(uint8_t id) { return buffers[groupOf(id)].getCurrent(slotOf(id)); }
+    
+private:
+    
+    std::array<Buffer, num_groups> buffers;
+    std::array<uint8_t, num_groups> addrs;
 };
 
 
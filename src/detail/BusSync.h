@@ -0,0 +1,144 @@
+#ifndef OFXMODBUSORIENTAL_BUSSYNC_H
+#define OFXMODBUSORIENTAL_BUSSYNC_H
+
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ControllerCore.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// starts the motors of several buses at the same moment.
+// each bus runs on its own tick phase, so start(0) on every bus goes out up to one interval apart.
+// start() waits until the commands staged on every bus (set*() / write*(), data_no(), ...) are
+// confirmed, then releases one start frame per bus at a common steady_clock time, off the tick
+// schedule, followed by clear(). the write time of each frame is measured, getReport().skew() is
+// the spread between buses. any thread, the buses may run on startThread() or be updated by the caller
+template <size_t Size>
+class BusSync
+{
+public:
+
+    struct Report
+    {
+        Nanos target {0};           // common release time, 0 until every bus is staged
+        std::vector<Nanos> written; // per bus, when its start frame was handed to the transport, 0 until then
+
+        bool complete() const
+        {
+            return !written.empty() && std::none_of(written.begin(), written.end(), [](Nanos t) { return t == 0; });
+        }
+        // latest - earliest write
+        Nanos skew() const
+        {
+            if (!complete()) return 0;
+            auto mm = std::minmax_element(written.begin(), written.end());
+            return *mm.second - *mm.first;
+        }
+        // latest write - target
+        Nanos late() const { return complete() ? *std::max_element(written.begin(), written.end()) - target : 0; }
+    };
+
+    void add(ControllerCore<Size>& core) { buses.push_back(&core); }
+    size_t size() const { return buses.size(); }
+
+    // call after staging the commands of every bus. lead_sec is the time from the moment
+    // the last bus is staged to the release, enough for the I/O threads to be scheduled.
+    // resolves when every start frame is written, or with the first failure
+    Handle start(uint8_t id = 0, double lead_sec = 0.01)
+    {
+        auto run = std::make_shared<Run>();
+        run->buses = buses;
+        run->id = id;
+        run->lead = toNanos(lead_sec);
+        run->report.written.assign(buses.size(), 0);
+        run->done = std::make_shared<Completion>();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            last = run;
+        }
+        if (buses.empty())
+        {
+            run->done->resolve(Result::Status::Invalid);
+            return Handle(run->done);
+        }
+        // fences first, so that the release can not come before the last one is in place
+        std::vector<Handle> fences;
+        for (auto* bus : buses) fences.push_back(bus->fence());
+        for (auto& f : fences) f.then([run](const Result& r) { staged(run, r); });
+        return Handle(run->done);
+    }
+
+    // of the last start()
+    Report getReport() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!last) return Report();
+        std::lock_guard<std::mutex> run_lock(last->mutex);
+        return last->report;
+    }
+
+private:
+
+    struct Run
+    {
+        std::mutex mutex;
+        std::vector<ControllerCore<Size>*> buses;
+        uint8_t id {0};
+        Nanos lead {0};
+        size_t num_staged {0};
+        size_t num_written {0};
+        bool b_failed {false};
+        Report report;
+        std::shared_ptr<Completion> done;
+    };
+
+    // on the update() thread of each bus
+    static void staged(std::shared_ptr<Run> run, const Result& r)
+    {
+        Nanos target;
+        {
+            std::lock_guard<std::mutex> lock(run->mutex);
+            if (!r.ok() && !run->b_failed) logError("ofxModbusOriental") << "bus sync : a bus could not be staged, nothing started";
+            if (!r.ok()) run->b_failed = true;
+            if (run->b_failed || ++run->num_staged < run->buses.size()) target = 0;
+            else target = run->report.target = nowNanos() + run->lead;
+        }
+        if (!r.ok()) run->done->resolve(r.status);
+        if (!target) return;
+
+        for (size_t b = 0; b < run->buses.size(); ++b)
+        {
+            ControllerCore<Size>* bus = run->buses[b];
+            bus->startAt(run->id, target, [run, bus, b](Nanos t)
+            {
+                bus->clear(run->id);
+                written(run, b, t);
+            }).then([run](const Result& r)
+            {
+                if (!r.ok()) run->done->resolve(r.status);
+            });
+        }
+    }
+
+    static void written(std::shared_ptr<Run> run, size_t b, Nanos t)
+    {
+        bool b_all;
+        {
+            std::lock_guard<std::mutex> lock(run->mutex);
+            run->report.written[b] = t;
+            b_all = (++run->num_written == run->buses.size());
+        }
+        if (b_all) run->done->resolve(Result::Status::Done);
+    }
+
+    std::vector<ControllerCore<Size>*> buses;
+    mutable std::mutex mutex;
+    std::shared_ptr<Run> last;
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_BUSSYNC_H */
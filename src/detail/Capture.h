@@ -0,0 +1,144 @@
+#ifndef OFXMODBUSORIENTAL_CAPTURE_H
+#define OFXMODBUSORIENTAL_CAPTURE_H
+
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include "Log.h"
+#include "MappedFile.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// binary bus traffic log
+//
+// header  : "OMCAP" + version (6 bytes)
+// records : time [ns, uint64] + direction [uint8] + size [uint16] + bytes
+// integers are stored in host byte order, time is steady_clock since capture start
+
+enum class Direction : uint8_t { Tx, Rx };
+
+static const char capture_magic[5] = { 'O', 'M', 'C', 'A', 'P' };
+static const uint8_t capture_version = 1;
+static const size_t capture_header_size = 6;
+static const size_t capture_record_header_size = 11;
+
+class Capture
+{
+public:
+
+    ~Capture() { close(); }
+
+    bool open(const std::string& path)
+    {
+        close();
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+        file.write(capture_magic, sizeof(capture_magic));
+        file.put((char)capture_version);
+        origin = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void close() { if (file.is_open()) file.close(); }
+
+    bool isOpen() const { return file.is_open(); }
+
+    void record(Direction dir, const uint8_t* data, size_t size)
+    {
+        if (!file.is_open() || size == 0) return;
+
+        uint64_t t = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+        uint8_t d = (uint8_t)dir;
+        uint16_t s = (uint16_t)size;
+
+        char header[capture_record_header_size];
+        memcpy(header + 0, &t, sizeof(t));
+        memcpy(header + 8, &d, sizeof(d));
+        memcpy(header + 9, &s, sizeof(s));
+        file.write(header, sizeof(header));
+        file.write((const char*)data, s);
+    }
+
+private:
+
+    std::ofstream file;
+    std::chrono::steady_clock::time_point origin;
+};
+
+
+// memory-mapped reader for the files written by Capture
+class CaptureReader
+{
+public:
+
+    struct Record
+    {
+        uint64_t time_ns;
+        Direction dir;
+        const uint8_t* data;
+        uint16_t size;
+    };
+
+    ~CaptureReader() { close(); }
+
+    bool open(const std::string& path)
+    {
+        close();
+        if (!file.open(path) || file.size() < capture_header_size) { close(); return false; }
+        head = file.data();
+        length = file.size();
+        file.sequential();
+
+        if (memcmp(head, capture_magic, sizeof(capture_magic)) != 0 || head[5] != capture_version)
+        {
+            logError("ofxModbusOriental") << "not a capture file or unknown version " << path;
+            close();
+            return false;
+        }
+        rewind();
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        head = nullptr;
+        length = cursor = 0;
+    }
+
+    bool isOpen() const { return head != nullptr; }
+
+    void rewind() { cursor = capture_header_size; }
+
+    bool next(Record& r)
+    {
+        if (cursor + capture_record_header_size > length) return false;
+
+        const uint8_t* p = head + cursor;
+        uint8_t d;
+        memcpy(&r.time_ns, p + 0, sizeof(r.time_ns));
+        memcpy(&d, p + 8, sizeof(d));
+        memcpy(&r.size, p + 9, sizeof(r.size));
+        if (cursor + capture_record_header_size + r.size > length) return false; // truncated tail
+
+        r.dir = (Direction)d;
+        r.data = p + capture_record_header_size;
+        cursor += capture_record_header_size + r.size;
+        return true;
+    }
+
+    size_t size() const { return length; }
+
+private:
+
+    MappedFile file;
+    const uint8_t* head {nullptr};
+    size_t length {0};
+    size_t cursor {0};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_CAPTURE_H */
@@ -0,0 +1,945 @@
+#ifndef OFXMODBUSORIENTAL_CONTROLLERCORE_H
+#define OFXMODBUSORIENTAL_CONTROLLERCORE_H
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include "Stream.h"
+#include "Buffer.h"
+#include "IoThread.h"
+#include "FrameCache.h"
+#include "Motion.h"
+#include "IntervalTuner.h"
+#include "SeqLock.h"
+#include "Fleet.h"
+#include "VelocityStream.h"
+
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// protocol engine without openFrameworks
+// feed it any Transport (SerialPort, your own, ...) and call update() from your loop
+//
+// one-shot commands (request, stop, free, reset, data_no, start, clear, forward, backward,
+// direct, setJogSteps) are thread-safe and may be called from any thread. they reach update()
+// through a lock-free queue, only the shadow registers (write suppression) take a short lock.
+// set*() / write*() share the concurrent Buffer and belong to the update() thread.
+template <size_t Size>
+class ControllerCore
+{
+public:
+
+    static_assert(Size >= 1 && Size <= 247, "modbus unicast ids are 1 - 247");
+
+	struct Status
+	{
+        bool tlc {true};
+        bool move {true};
+        bool busy {true};
+        bool alarm {true};
+        bool ready {false};
+
+        bool operator== (const Status& s) const
+        {
+            return tlc == s.tlc && move == s.move && busy == s.busy && alarm == s.alarm && ready == s.ready;
+        }
+        bool operator!= (const Status& s) const { return !(*this == s); }
+	};
+
+    // fired only when a decoded status differs from the previous one of the same motor
+    struct StatusEvent
+    {
+        uint8_t id;
+        Status prev;
+        Status curr;
+        Nanos time; // steady_clock [ns] when the reply was decoded
+
+        bool alarmRaised() const { return !prev.alarm && curr.alarm; }
+        bool alarmCleared() const { return prev.alarm && !curr.alarm; }
+        bool becameReady() const { return !prev.ready && curr.ready; }
+        bool stoppedMoving() const { return prev.move && !curr.move; }
+    };
+    using StatusListener = std::function<void(const StatusEvent&)>;
+
+    // consistent copy of the fleet state, published by update() after each decoded batch
+    struct Telemetry
+    {
+        FleetState<Size> fleet;
+        std::array<int32_t, Size + 1> wrote_pos;
+        Nanos time; // steady_clock [ns] of the publication
+        uint64_t version; // 0 until the first publication
+
+        Telemetry() : wrote_pos(), time(0), version(0) {}
+
+        bool ready(uint8_t id) const { return fleet.ready(id); }
+    };
+
+    ControllerCore()
+    {
+        FrameCache::warmup();
+        serial.setWaker([this] { io.wake(); });
+    }
+    ~ControllerCore()
+    {
+        stopThread();
+        saveInterval();
+    }
+
+    bool begin(std::shared_ptr<Transport> transport, double interval)
+    {
+        serial.begin(transport);
+        serial.setInterval(interval); // sometimes drops in 0.05 sec
+        return serial.isOpen();
+    }
+	
+    void update()
+    {
+        streamTick();
+		serial.update();
+        if (b_auto_interval) tuneInterval();
+
+		while (serial.available())
+		{
+			Request& req = serial.getResponse();
+            if (req.isException())
+            {
+                logError("ofxModbusOriental") << "exception " << (int)req.getException() << " from " << (int)req.getID();
+                req.resolve(Result::Status::Exception);
+                serial.archiveResponse();
+                continue;
+            }
+            switch(req.getKey())
+            {
+                case RequestType::Status:
+                case RequestType::Position:
+                case RequestType::Monitor:
+                {
+                    applyDecoded(req.getID(), req.getDecoded());
+                    b_telemetry_dirty.store(true, std::memory_order_relaxed);
+                    break;
+                }
+                case RequestType::Block: break; // the registers are in the caller's vector
+                default:
+                {
+                    // TODO: not broadcast motion response
+                    logError("ofxModbusOriental") << "response [invalid]";
+                    break;
+                }
+            }
+            req.resolve(Result::Status::Done, req.getResponse());
+			serial.archiveResponse();
+		}
+        if (b_telemetry_dirty.exchange(false, std::memory_order_acq_rel)) publishTelemetry();
+    }
+    
+	Handle request(RequestType r, uint8_t id)
+    {
+        if (id == 0 || serial.isGroupAddress(id))
+        {
+            logError("ofxModbusOriental") << (int)id << " is a broadcast or group addr, invalid request";
+            return Handle::resolved(Result::Status::Invalid);
+        }
+        if (r != RequestType::Monitor) return serial.request(r, id);
+        auto map = std::atomic_load(&monitor_map);
+        if (map) return serial.request(map, id);
+        logError("ofxModbusOriental") << "no monitor map, see setMonitorMap()";
+        return Handle::resolved(Result::Status::Invalid);
+    }
+    
+    // register range read by request(RequestType::Monitor, id) and the channels decoded from it,
+    // e.g. status, alarm code, position and load in one round trip. addresses are those of your
+    // drive's manual. false when a field lies outside the range
+    bool setMonitorMap(const ReadMap& map)
+    {
+        if (!map.valid())
+        {
+            logError("ofxModbusOriental") << "invalid monitor map";
+            return false;
+        }
+        std::atomic_store(&monitor_map, std::make_shared<const ReadMap>(map));
+        return true;
+    }
+
+    // any register range, see Stream::readRegisters() and ParameterDump
+    Handle readRegisters(uint8_t id, uint16_t addr, uint16_t count, std::shared_ptr<std::vector<uint16_t>> out)
+    {
+        if (id != 0 && !serial.isGroupAddress(id)) return serial.readRegisters(id, addr, count, out);
+        logError("ofxModbusOriental") << (int)id << " is a broadcast or group addr, invalid request";
+        return Handle::resolved(Result::Status::Invalid);
+    }
+    
+    Handle writeRegisters(uint8_t id, uint16_t addr, const std::vector<uint16_t>& values)
+    {
+        return pushSetting(registerWrite(id, addr, values));
+    }
+
+	Handle stop(uint8_t id)
+	{
+		return serial.push_front(FrameCache::remoteIOs(CmdType::Stop, id), onHalted(id));
+	}
+    
+    // stop which does not wait behind anything : cancels waiting requests and queued commands,
+    // sends the prebuilt stop frame at the next tick and again on the repeats ticks after it.
+    // worst case from here to the wire is about one interval (+ the update() wake up when it
+    // runs on startThread()), the measured one is getStopLatency()
+    Handle emergencyStop(uint8_t id = 0, size_t repeats = 0)
+    {
+        forEachMotor(id, [&](uint8_t i) { stream.halt(i); }); // no setpoint or ramp down frame may restart it
+        return serial.emergency(FrameCache::remoteIOs(CmdType::Stop, id), repeats, onHalted(id));
+    }
+    Stream::StopLatency getStopLatency() const { return serial.getStopLatency(); }
+    void resetStopLatency() { serial.resetStopLatency(); }
+    
+//	void home(uint8_t id)
+//	{
+//		directDrive(id, offsets[id], 10000, 3000, 3000);
+//	}
+    
+	Handle free(uint8_t id)
+	{
+		return serial.push_back(FrameCache::remoteIOs(CmdType::Free, id), onHalted(id));
+	}
+    
+    Handle reset(uint8_t id)
+	{
+		return serial.push_back(FrameCache::remoteIOs(CmdType::Reset, id));
+	}
+
+    Handle data_no(uint8_t no, uint8_t id)
+	{
+		return pushSetting(NetSelect(no, id).frame());
+	}
+
+    // runs the buffered setpoints (set*() / write*()) or the selected data number
+    Handle start(uint8_t id)
+	{
+		return serial.push_back(FrameCache::remoteIOs(CmdType::Start, id), onStarted(id));
+	}
+
+    // same as start(), written at steady_clock time at instead of at the next tick (see BusSync).
+    // on_written gets the time it was handed to the transport, on the update() thread
+    Handle startAt(uint8_t id, Nanos at, std::function<void(Nanos)> on_written = nullptr)
+	{
+		return serial.push_at(FrameCache::remoteIOs(CmdType::Start, id), at, onStarted(id), on_written);
+	}
+
+    // resolves when every command submitted before it has been written and confirmed
+    Handle fence() { return serial.fence(); }
+
+    // same as start(), when the drive runs p (e.g. uploaded to its data number, see ProgramCache)
+    Handle start(uint8_t id, const Profile& p)
+	{
+		return serial.push_back(FrameCache::remoteIOs(CmdType::Start, id), onCommanded(id, p));
+	}
+
+    Handle clear(uint8_t id)
+	{
+		return serial.push_back(FrameCache::remoteIOs(CmdType::Clear, id));
+	}
+
+    Handle forward(uint8_t id)
+    {
+		return serial.push_back(FrameCache::remoteIOs(CmdType::JogFwd, id));
+    }
+
+    Handle backward(uint8_t id)
+    {
+		return serial.push_back(FrameCache::remoteIOs(CmdType::JogBwd, id));
+    }
+
+    Handle direct
+    (
+        uint8_t id, uint32_t abs_pos, uint32_t vel, uint32_t acc, uint32_t dec,
+        uint8_t mode = 0x01, uint16_t crnt = 0x03E8, char trig = 1, uint8_t data_no = 0xFF
+    ){
+		DirectDrive drive(id);
+        drive.setDriveNo(data_no);
+        drive.setDriveMode(mode);
+        drive.setPosition(abs_pos);
+        drive.setVelocity(vel);
+        drive.setAcceleration(acc);
+        drive.setDeceleration(dec);
+        drive.setCurrent(crnt);
+        drive.setTrigger(trig);
+        Profile p((int32_t)abs_pos, (int32_t)vel, acc, dec, mode, crnt);
+		return serial.push_back(drive.frame(), trig ? onCommanded(id, p) : nullptr);
+    }
+
+    // store a motion in drive data number no, run it later with data_no() + start()
+    Handle writeOperationData
+    (
+        uint8_t id, uint8_t no, int32_t abs_pos, int32_t vel, uint32_t acc, uint32_t dec,
+        uint8_t mode = 0x01, uint16_t crnt = 0x03E8
+    ){
+		OperationData data(no, id);
+        data.setDriveMode(mode);
+        data.setPosition(abs_pos);
+        data.setVelocity(vel);
+        data.setAcceleration(acc);
+        data.setDeceleration(dec);
+        data.setCurrent(crnt);
+		return pushSetting(data.frame());
+    }
+
+    // continuous velocity control, for joysticks and the like, instead of fixed step jogs.
+    // streamVelocity() only replaces the newest setpoint, rate_hz times per second the newest one
+    // of each axis goes out as a direct data operation (at most one frame per axis in the queue).
+    // when no setpoint comes for timeout_sec, or after stopVelocityStream(), the axis gets
+    // velocity 0 and ramps down with dec. mode 16 is continuous operation (speed control) of AZ series
+    void startVelocityStream(uint8_t id, uint32_t acc, uint32_t dec, double rate_hz = 50.0, double timeout_sec = 0.2,
+        uint16_t crnt = 0x03E8, uint8_t mode = 16)
+    {
+        stream_acc.store(acc, std::memory_order_relaxed);
+        stream_dec.store(dec, std::memory_order_relaxed);
+        stream_crnt.store(crnt, std::memory_order_relaxed);
+        stream_mode.store(mode, std::memory_order_relaxed);
+        stream.setPeriod(toNanos(1.0 / std::max(rate_hz, 1e-3)));
+        stream.setTimeout(toNanos(timeout_sec));
+        forEachMotor(id, [&](uint8_t i) { stream.activate(i, true); });
+        io.wake();
+    }
+    void stopVelocityStream(uint8_t id = 0)
+    {
+        forEachMotor(id, [&](uint8_t i) { stream.activate(i, false); });
+        io.wake();
+    }
+    // [step/s], signed. lock-free, any thread
+    void streamVelocity(uint8_t id, int32_t vel)
+    {
+        Nanos now = nowNanos();
+        forEachMotor(id, [&](uint8_t i) { stream.set(i, vel, now); });
+    }
+    // streamVelocity() to the echo of the frame which carried it
+    typename VelocityStream<Size>::Latency getStreamLatency() const { return stream.getLatency(); }
+    void resetStreamLatency() { stream.resetLatency(); }
+    // ramp downs because the setpoints stopped coming
+    size_t getNumStreamTimeouts() const { return stream.getNumTimeouts(); }
+
+    Handle setJogSteps(uint8_t id, uint32_t steps)
+    {
+		return pushSetting(JogSteps(steps, id).frame());
+    }
+
+
+    void setPosition(uint8_t id, int32_t pos)
+    {
+        forEachMotor(id, [&](uint8_t i) { buffer.setPosition(i, pos); });
+    }
+    void setVelocity(uint8_t id, int32_t vel)
+    {
+        forEachMotor(id, [&](uint8_t i) { buffer.setVelocity(i, vel); });
+    }
+    void setMode(uint8_t id, uint8_t mode)
+    {
+        forEachMotor(id, [&](uint8_t i) { buffer.setMode(i, mode); });
+    }
+    void setAcceleration(uint8_t id, uint32_t acc)
+    {
+        forEachMotor(id, [&](uint8_t i) { buffer.setAcceleration(i, acc); });
+    }
+    void setDeceleration(uint8_t id, uint32_t dec)
+    {
+        forEachMotor(id, [&](uint8_t i) { buffer.setDeceleration(i, dec); });
+    }
+    void setCurrent(uint8_t id, uint32_t crnt)
+    {
+        forEachMotor(id, [&](uint8_t i) { buffer.setCurrent(i, crnt); });
+    }
+    
+    // resolves with the last of the four frames
+    Handle write(uint8_t id)
+    {
+        writePosition(id);
+        writeVelocity(id);
+        writeAcceleration(id);
+        return writeDeceleration(id);
+    }
+
+	Handle writePosition(uint8_t id)
+	{
+        for (size_t i = 1; i < wrote_pos.size(); ++i)
+            wrote_pos[i] = buffer.getPosition(i);
+        b_telemetry_dirty.store(true, std::memory_order_relaxed);
+        
+		return writeGroups(id, &Buffer::getPositionFrame);
+	}
+
+	Handle writeVelocity(uint8_t id)
+	{
+		return writeGroups(id, &Buffer::getVelocityFrame);
+	}
+
+	Handle writeMode(uint8_t id)
+	{
+		return writeGroups(id, &Buffer::getModeFrame);
+	}
+
+	Handle writeAcceleration(uint8_t id)
+	{
+		return writeGroups(id, &Buffer::getAccelerationFrame);
+	}
+
+	Handle writeDeceleration(uint8_t id)
+	{
+		return writeGroups(id, &Buffer::getDecelerationFrame);
+	}
+
+	Handle writeCurrent(uint8_t id)
+	{
+		return writeGroups(id, &Buffer::getCurrentFrame);
+	}
+
+    // returns the last confirmed value when it is younger than max_age_sec,
+    // otherwise asks the drive. Status and Position only, the others have no fixed register
+    Handle read(RequestType r, uint8_t id, double max_age_sec)
+    {
+        if (!Request::readMap(r))
+        {
+            logError("ofxModbusOriental") << "read() needs a fixed register, use request()";
+            return Handle::resolved(Result::Status::Invalid);
+        }
+        ShadowRegisters::Entry e;
+        if (id != 0 && serial.getShadow().get(id, Request::address(r), e, toNanos(max_age_sec)))
+            return Handle::resolved(Result::Status::Done, e.value);
+        return request(r, id);
+    }
+    
+    // seconds since the drive confirmed this value, infinity when it never did
+    double getAge(RequestType r, uint8_t id)
+    {
+        ShadowRegisters::Entry e;
+        if (!Request::readMap(r) || !serial.getShadow().get(id, Request::address(r), e)) return std::numeric_limits<double>::infinity();
+        return toSec(nowNanos() - e.time);
+    }
+    
+    // skip setting writes (data_no, setJogSteps, writeOperationData, unicast write*) whose values the drive
+    // has already confirmed. off by default, the shadow can't see a drive power cycle,
+    // call invalidateShadow() when one happens
+    void setWriteSuppression(bool b) { b_suppress = b; }
+    void invalidateShadow(uint8_t id = 0) { serial.getShadow().invalidate(id); }
+    size_t getNumSuppressed() { return num_suppressed; }
+	
+    // more than BufferGroups::slots_per_group axes are split into groups of concurrent frames,
+    // write*(0) sends one frame per group to its address. every group needs its own address
+    // (Size < addr <= 247) before write*(0) is accepted, see BufferGroups
+    bool setGroupAddress(size_t group, uint8_t addr)
+    {
+        if (group >= buffer.size() || addr <= Size || addr > FrameCache::max_id)
+        {
+            logError("ofxModbusOriental") << "group " << group << " address " << (int)addr << " : group must be < " << buffer.size()
+                << ", address " << Size + 1 << " - " << (int)FrameCache::max_id;
+            return false;
+        }
+        uint8_t prev = buffer.getAddress(group);
+        buffer.setAddress(group, addr);
+        serial.setGroupAddress(addr, true);
+        if (prev != 0 && prev != addr && !isDriveGroup(prev))
+        {
+            bool b_used = false;
+            for (size_t g = 0; g < buffer.size(); ++g) b_used |= (buffer.getAddress(g) == prev);
+            if (!b_used) serial.setGroupAddress(prev, false);
+        }
+        return true;
+    }
+    size_t getNumGroups() { return buffer.size(); }
+    
+    // drive group : the motors ids also take frames to addr, so stop(addr), start(addr),
+    // data_no(no, addr), direct(addr, ...) ... reach all of them in one frame, which is never answered.
+    // addr must not be a motor id (Size < addr <= 247). a drive is in one group at most, ids leave
+    // their previous group. b_configure writes the group address into the drives (and -1 into the
+    // drives which left), the Handle is the last of these writes.
+    // call from the update() thread or before startThread()
+    Handle setDriveGroup(uint8_t addr, const std::vector<uint8_t>& ids, bool b_configure = true)
+    {
+        if (addr <= Size || addr > FrameCache::max_id)
+        {
+            logError("ofxModbusOriental") << "drive group address " << (int)addr << " must be " << Size + 1 << " - " << (int)FrameCache::max_id;
+            return Handle::resolved(Result::Status::Invalid);
+        }
+        typename FleetState<Size>::Mask mask {};
+        for (uint8_t id : ids)
+            if (id >= 1 && id <= Size) mask[id / 64] |= (uint64_t)1 << (id % 64);
+        
+        Handle h = Handle::resolved(Result::Status::Done);
+        for (uint8_t id : FleetState<Size>::ids(drive_groups[addr]))
+        {
+            if ((mask[id / 64] >> (id % 64)) & 1) continue;
+            if (b_configure) h = pushSetting(GroupAddress(-1, id).frame());
+        }
+        for (size_t g = Size + 1; g <= FrameCache::max_id; ++g)
+        {
+            if (g == addr) continue;
+            for (size_t w = 0; w < mask.size(); ++w) drive_groups[g][w] &= ~mask[w];
+        }
+        drive_groups[addr] = mask;
+        for (uint8_t id : FleetState<Size>::ids(mask))
+            if (b_configure) h = pushSetting(GroupAddress(addr, id).frame());
+        serial.setGroupAddress(addr, true);
+        return h;
+    }
+    Handle removeDriveGroup(uint8_t addr, bool b_configure = true)
+    {
+        if (!isDriveGroup(addr)) return Handle::resolved(Result::Status::Invalid);
+        Handle h = setDriveGroup(addr, {}, b_configure);
+        bool b_concurrent = false;
+        for (size_t g = 0; g < buffer.size(); ++g) b_concurrent |= (buffer.getAddress(g) == addr);
+        if (!b_concurrent) serial.setGroupAddress(addr, false);
+        return h;
+    }
+    bool isDriveGroup(uint8_t addr) const
+    {
+        if (addr <= Size || addr > FrameCache::max_id) return false;
+        for (uint64_t w : drive_groups[addr]) if (w) return true;
+        return false;
+    }
+    std::vector<uint8_t> getDriveGroup(uint8_t addr) const
+    {
+        if (addr <= Size || addr > FrameCache::max_id) return {};
+        return FleetState<Size>::ids(drive_groups[addr]);
+    }
+    
+    void setInterval(double sec) { serial.setInterval(sec); }
+    double getInterval() { return serial.getInterval(); }
+    
+    // let the interval follow the bus : back off at once on timeouts or crc errors,
+    // and shorten it while frames go through cleanly (see IntervalTuner).
+    // path : the chosen interval is read from it now and written back while running.
+    // call before startThread()
+    void setAutoInterval(bool b, const std::string& path = "", const IntervalTuner::Settings& s = IntervalTuner::Settings())
+    {
+        b_auto_interval = b;
+        tuner = IntervalTuner(s);
+        tuner_path = path;
+        double sec;
+        if (b && !path.empty() && IntervalTuner::load(path, sec)) setInterval(sec);
+    }
+    
+    void setVelocityLimit(int32_t v) { max_vel = v; }
+	
+	void setMotionTriangle(uint8_t id, int32_t pos, float time)
+	{
+        if (id == 0) for (size_t i = 1; i <= getNumMotors(); ++i)
+            setMotionTriangleImpl(i, pos, time);
+        else
+            setMotionTriangleImpl(id, pos, time);
+	}
+    
+	void setMotionTrapezoid(uint8_t id, int32_t target_pos, uint32_t target_acc, float time)
+	{
+        if (id == 0) for (size_t i = 1; i <= getNumMotors(); ++i)
+            setMotionTrapezoidImpl(i, target_pos, target_acc, time);
+        else
+            setMotionTrapezoidImpl(id, target_pos, target_acc, time);
+	}
+    
+    bool isOpen() { return serial.isOpen(); }
+    
+    // runs update() until every handle is resolved, sleeping until a byte arrives or the next
+    // frame is due in between. for apps which call update() themselves, with startThread()
+    // running it is waitAll()
+    bool wait(const std::vector<Handle>& handles, double timeout_sec)
+    {
+        if (io.isRunning()) return waitAll(handles, timeout_sec);
+        Nanos deadline = nowNanos() + toNanos(timeout_sec);
+        auto t = serial.getTransport();
+        int fd = t ? t->getFd() : -1;
+        while (true)
+        {
+            update();
+            if (std::all_of(handles.begin(), handles.end(), [](const Handle& h) { return h.ready(); })) return true;
+            Nanos now = nowNanos();
+            if (now >= deadline) return false;
+            Nanos due = nextDeadline();
+            // nothing due on this bus : the handles belong to others, or new commands may come from other threads
+            if (due < 0) waitAll(handles, toSec(std::min<Nanos>(deadline - now, 10000000)));
+            else IoThread::waitReadable(fd, std::min(due, deadline));
+        }
+    }
+    
+    // run update() on an event driven I/O thread instead of calling it yourself.
+    // it sleeps until a byte arrives or the next frame is due (see IoThread)
+    bool startThread()
+    {
+        auto t = serial.getTransport();
+        return io.start(t ? t->getFd() : -1, [this] { update(); }, [this] { return nextDeadline(); });
+    }
+    void stopThread() { io.stop(); }
+    bool isThreadRunning() const { return io.isRunning(); }
+    
+    bool empty() { return (query_size() || request_size() || serial.pending()) ? false : true; }
+
+    bool ready(uint8_t id = 0) { return (id == 0) ? fleet.allReady() : fleet.ready(id); }
+    
+    // status change notifications, O(changes) instead of polling every motor.
+    // listeners run inside update(), so register them on the update() thread or before startThread()
+    size_t onStatusChanged(StatusListener listener)
+    {
+        status_listeners.emplace_back(++listener_id, listener);
+        return listener_id;
+    }
+    void removeStatusListener(size_t id)
+    {
+        status_listeners.erase(std::remove_if(status_listeners.begin(), status_listeners.end(),
+            [id](const std::pair<size_t, StatusListener>& l) { return l.first == id; }), status_listeners.end());
+    }
+
+    // event queue for another thread (e.g. the app while update() runs on startThread())
+    // off by default, because nobody would drain it
+    void enableStatusEvents(bool b) { b_status_events = b; }
+    // single consumer
+    bool pollStatusEvent(StatusEvent& e) { return status_events.pop(e); }
+
+    bool isTrqLimit(uint8_t id) { return fleet.get(id, StatusFlag::Tlc); }
+    bool isMoving(uint8_t id) { return fleet.get(id, StatusFlag::Move); }
+    bool isBusy(uint8_t id) { return fleet.get(id, StatusFlag::Busy); }
+    bool hasAlarm(uint8_t id) { return fleet.get(id, StatusFlag::Alarm); }
+    bool isReady(uint8_t id) { return fleet.get(id, StatusFlag::Ready); }
+    
+    // every motor at once : fleet.ids(StatusFlag::Alarm), fleet.count(StatusFlag::Move),
+    // fleet.maxPositionError() ... (see FleetState). call from the update() thread
+    const FleetState<Size>& getFleet() const { return fleet; }
+    
+    size_t query_size() { return serial.query_size(); }
+    size_t request_size() { return serial.request_size(); }
+    
+    size_t getNumWrites() { return serial.getNumWrites(); }
+    size_t getNumResponses() { return serial.getNumResponses(); }
+    size_t getNumTimeouts() { return serial.getNumTimeouts(); }
+    size_t getNumCrcErrors() { return serial.getNumCrcErrors(); }
+    size_t getNumMalformed() { return serial.getNumMalformed(); }
+    size_t getNumWriteErrors() { return serial.getNumWriteErrors(); }
+    
+    bool startCapture(const std::string& path) { return serial.startCapture(path); }
+    void stopCapture() { serial.stopCapture(); }
+    
+    // keep the last capacity trace points of every command, see Stream::enableTrace()
+    void enableTrace(size_t capacity = 65536) { serial.enableTrace(capacity); }
+    void disableTrace() { serial.disableTrace(); }
+    bool writeChromeTrace(const std::string& path) { return serial.writeChromeTrace(path); }
+    
+    // drive the controller from a captured log instead of the serial port
+    // call update() after replay() to decode the replayed responses
+    void beginReplay() { serial.beginReplay(); }
+    void replay(Direction dir, const uint8_t* data, size_t size) { serial.replay(dir, data, size); }
+
+	size_t getNumMotors() { return Size; }
+    Status getStatus(uint8_t id)
+    {
+        Status s;
+        s.tlc = fleet.get(id, StatusFlag::Tlc);
+        s.move = fleet.get(id, StatusFlag::Move);
+        s.busy = fleet.get(id, StatusFlag::Busy);
+        s.alarm = fleet.get(id, StatusFlag::Alarm);
+        s.ready = fleet.get(id, StatusFlag::Ready);
+        return s;
+    }
+	int32_t getPosition(uint8_t id) { return fleet.getPosition(id); }
+	int32_t getPositionMax() { return pos_limit_max; }
+	int32_t getPositionMin() { return pos_limit_min; }
+	int32_t getVelocityMax() { return vel_limit_max; }
+	int32_t getVelocityMin() { return vel_limit_min; }
+	uint32_t getAccelerationMax() { return acc_limit; }
+	uint32_t getCurrentMax() { return crnt_limit; }
+    
+	int32_t getPositionBuffer(uint8_t id) { return wrote_pos[id]; }
+    
+    // getStatus(), getPosition(), ready() ... read the live arrays of the update() thread.
+    // other threads (draw() while startThread() runs) take a snapshot instead :
+    // lock-free, never blocks update(), every axis from the same batch
+    Telemetry getTelemetry() const { return telemetry.load(); }
+    bool tryGetTelemetry(Telemetry& t) const { return telemetry.tryLoad(t); }
+    uint64_t getTelemetryVersion() const { return telemetry.version(); }
+    
+    // dead-reckoned position between position replies, from the commanded moves
+    // (direct(), start() of the buffer or of a Profile, stop(), free()), re-anchored on every reply.
+    // call from the update() thread
+    double getEstimatedPosition(uint8_t id) { return motion.getPosition(id, nowNanos()); }
+    double getEstimatedPosition(uint8_t id, Nanos t) { return motion.getPosition(id, t); }
+    double getEstimatedVelocity(uint8_t id) { return motion.getVelocity(id, nowNanos()); }
+    // estimate - reply at each position reply
+    const typename MotionEstimator<Size>::Error& getEstimateError(uint8_t id) { return motion.getError(id); }
+    void resetEstimateError(uint8_t id = 0) { motion.reset(id); }
+    // step/s^2 per acceleration unit of the drives, 1 for the default 0.001 kHz/s
+    void setAccelerationUnit(double steps_per_sec2) { motion.setAccelerationUnit(steps_per_sec2); }
+	
+protected:
+
+    // steady_clock time [ns] of the next frame of the bus or of the velocity stream, -1 when idle
+    Nanos nextDeadline()
+    {
+        Nanos a = serial.deadline(), b = stream.deadline();
+        return (a < 0) ? b : (b < 0) ? a : std::min(a, b);
+    }
+
+    // id 0 : every motor, a drive group address : its members
+    template <typename F>
+    void forEachMotor(uint8_t id, F f)
+    {
+        if (id == 0) for (size_t i = 1; i <= getNumMotors(); ++i) f((uint8_t)i);
+        else if (id <= Size) f(id);
+        else if (id <= FrameCache::max_id) for (uint8_t i : FleetState<Size>::ids(drive_groups[id])) f(i);
+    }
+
+    // motion model hooks, run on the update() thread when the frame is written or echoed
+    Completion::Callback onCommanded(uint8_t id, const Profile& p)
+    {
+        return [this, id, p](const Result& r)
+        {
+            if (!r.ok()) return;
+            Nanos t = nowNanos();
+            forEachMotor(id, [&](uint8_t i) { motion.command(i, p, t); });
+        };
+    }
+    Completion::Callback onStarted(uint8_t id)
+    {
+        return [this, id](const Result& r)
+        {
+            if (!r.ok()) return;
+            Nanos t = nowNanos();
+            forEachMotor(id, [&](uint8_t i)
+            {
+                Profile p(buffer.getPosition(i), buffer.getVelocity(i), buffer.getAcceleration(i), buffer.getDeceleration(i), buffer.getMode(i));
+                motion.command(i, p, t);
+            });
+        };
+    }
+    Completion::Callback onHalted(uint8_t id)
+    {
+        return [this, id](const Result& r)
+        {
+            if (!r.ok()) return;
+            Nanos t = nowNanos();
+            forEachMotor(id, [&](uint8_t i) { motion.halt(i, t); });
+        };
+    }
+
+    // id 0 : one frame per group, back to back, each to its group address.
+    // a drive group address : the frame of the group of its members, to that address.
+    // otherwise the frame of the group of id, to that drive only
+    Handle writeGroups(uint8_t id, Buffer::FrameOf frame)
+    {
+        if (id > Size)
+        {
+            // drive group : the frame of the concurrent group its members are in, to its address
+            std::vector<uint8_t> ids = getDriveGroup(id);
+            if (ids.empty() || buffer.groupOf(ids.front()) != buffer.groupOf(ids.back()))
+            {
+                logError("ofxModbusOriental") << "write to " << (int)id << " : not a drive group, or its motors are in different groups of "
+                    << (int)BufferGroups<Size>::slots_per_group;
+                return Handle::resolved(Result::Status::Invalid);
+            }
+            return pushSetting((buffer.group(buffer.groupOf(ids.front())).*frame)(id));
+        }
+        if (id != 0)
+        {
+            return pushSetting((buffer.group(buffer.groupOf(id)).*frame)(id));
+        }
+        if (!buffer.addressed())
+        {
+            logError("ofxModbusOriental") << "groups share an address, their slots would overwrite each other, see setGroupAddress()";
+            return Handle::resolved(Result::Status::Invalid);
+        }
+        Handle h;
+        for (size_t g = 0; g < buffer.size(); ++g)
+        {
+            h = pushSetting((buffer.group(g).*frame)(buffer.getAddress(g)));
+        }
+        return h;
+    }
+
+    void streamTick()
+    {
+        stream.tick(nowNanos(), [this](const typename VelocityStream<Size>::Send& s)
+        {
+            DirectDrive drive(s.id);
+            drive.setDriveMode(stream_mode.load(std::memory_order_relaxed));
+            drive.setVelocity((uint32_t)s.vel);
+            drive.setAcceleration(stream_acc.load(std::memory_order_relaxed));
+            drive.setDeceleration(stream_dec.load(std::memory_order_relaxed));
+            drive.setCurrent(stream_crnt.load(std::memory_order_relaxed));
+            if (s.b_ramp && stream.isActive(s.id))
+                logWarning("ofxModbusOriental") << "no velocity setpoint for motor " << (int)s.id << ", ramping down";
+            serial.push_back(drive.frame(), [this, s](const Result& r) { stream.confirm(s, r.ok(), nowNanos()); });
+        });
+    }
+
+    void tuneInterval()
+    {
+        size_t errors = serial.getNumTimeouts() + serial.getNumEchoTimeouts() + serial.getNumCrcErrors() + serial.getNumWriteErrors();
+        double sec = tuner.update(serial.getInterval(), serial.getNumWrites(), errors, serial.takeMaxLatency());
+        if (toNanos(sec) != toNanos(serial.getInterval()))
+        {
+            serial.setInterval(sec);
+            b_interval_changed = true;
+        }
+        if (b_interval_changed && nowNanos() - last_save > toNanos(10.0)) saveInterval();
+    }
+
+    void saveInterval()
+    {
+        if (!b_interval_changed || tuner_path.empty()) return;
+        if (!IntervalTuner::save(tuner_path, serial.getInterval()))
+            logWarning("ofxModbusOriental") << "could not save interval to " << tuner_path;
+        b_interval_changed = false;
+        last_save = nowNanos();
+    }
+
+    Handle pushSetting(const Frame& f)
+    {
+        if (b_suppress && serial.getShadow().matches(f.data(), f.size()))
+        {
+            ++num_suppressed;
+            return Handle::resolved(Result::Status::Done);
+        }
+        return serial.push_back(f);
+    }
+
+    void publishTelemetry()
+    {
+        Telemetry t;
+        t.fleet = fleet;
+        t.wrote_pos = wrote_pos;
+        t.time = nowNanos();
+        t.version = telemetry.version() + 1;
+        telemetry.store(t);
+    }
+
+    // one reply, any subset of the channels
+    void applyDecoded(uint8_t id, const Request::Decoded& d)
+    {
+        Nanos now = nowNanos();
+        if (d.has(Channel::Status))
+        {
+            uint32_t data = (uint32_t)d.get(Channel::Status);
+            Status s;
+            s.tlc = ((data >> 8) & 0x80);
+            s.move = ((data >> 8) & 0x20);
+            s.busy = ((data >> 8) & 0x01);
+            s.alarm = ((data >> 0) & 0x80);
+            s.ready = ((data >> 0) & 0x20);
+            if (s != getStatus(id)) notifyStatus(id, s);
+        }
+        if (d.has(Channel::Alarm)) fleet.setAlarmCode(id, d.get(Channel::Alarm));
+        if (d.has(Channel::Load)) fleet.setLoad(id, d.get(Channel::Load));
+        if (d.has(Channel::Position))
+        {
+            int32_t p = d.get(Channel::Position);
+            wrote_pos[id] = p;
+            motion.anchor(id, p, now);
+            fleet.setPosition(id, p);
+            fleet.setTarget(id, (int32_t)std::round(motion.getTarget(id)));
+            fleet.setVelocity(id, (float)motion.getVelocity(id, now));
+        }
+        // measured by the drive, rather than estimated from positions
+        if (d.has(Channel::Velocity)) fleet.setVelocity(id, (float)d.get(Channel::Velocity));
+    }
+    
+    void notifyStatus(uint8_t id, const Status& s)
+    {
+        StatusEvent e {id, getStatus(id), s, nowNanos()};
+        fleet.set(id, StatusFlag::Tlc, s.tlc);
+        fleet.set(id, StatusFlag::Move, s.move);
+        fleet.set(id, StatusFlag::Busy, s.busy);
+        fleet.set(id, StatusFlag::Alarm, s.alarm);
+        fleet.set(id, StatusFlag::Ready, s.ready);
+        for (auto& l : status_listeners) l.second(e);
+        if (b_status_events) status_events.push(std::move(e));
+    }
+
+    void setMotionTriangleImpl(uint8_t id, int32_t pos, float time)
+    {
+		assert(std::abs(((float)pos - (float)wrote_pos[id]) / time) < max_vel);
+        Profile p = triangleProfile(wrote_pos[id], pos, time, vel_limit_max, acc_limit);
+        buffer.setAcceleration(id, p.acc);
+        buffer.setDeceleration(id, p.dec);
+        buffer.setVelocity(id, p.vel); // if needed
+        buffer.setPosition(id, p.pos);
+    }
+	
+	void setMotionTrapezoidImpl(uint8_t id, int32_t target_pos, uint32_t target_acc, float time)
+	{
+//        float diff_pos = (float)(target_pos - wrote_pos[id]);
+//		float avg_vel = diff_pos / time;
+//		float vel = 0.f;
+//		float acc = 0.f;
+//        
+//        cout << dec;
+//        cout << "prev pos = " << wrote_pos[id] << endl;
+//        cout << "next pos = " << target_pos << endl;
+//        cout << "time     = " << time << endl;
+//        cout << "avg  vel = " << avg_vel << endl;
+//        
+//        // TODO: if acc is too fast, upper line is vanished....., so limit acc
+//        // TODO: if target_acc ( time < 4.f * avg_vel, vel = nan......
+//        
+//        if (std::abs(avg_vel) <= 500.f)
+//        {
+//            cout << "constant vel drive" << dec << endl;
+//			vel = avg_vel;
+//		}
+//		else
+//		{
+//            cout << "trapezoid vel drive" << dec << endl;
+//			vel = (target_acc * time + sqrt(target_acc * time * (target_acc * time - 4.f * avg_vel))) / 2.f;
+////			float time_const_vel = time - 2.f * vel / target_acc;
+//		}
+//        buffer.setAcceleration(id, target_acc); // if needed
+//        buffer.setDeceleration(id, target_acc); // if needed
+//		buffer.setVelocity(id, (int32_t)vel);
+//		buffer.setPosition(id, target_pos);
+//        cout << "pos = " << target_pos << endl;
+//        cout << "vel = " << vel << endl;
+//        cout << "acc = " << target_acc << endl;
+	}
+	
+    Stream serial;
+    BufferGroups<Size> buffer;
+    IoThread io;
+    MotionEstimator<Size> motion;
+
+    IntervalTuner tuner;
+    std::string tuner_path;
+    bool b_auto_interval {false};
+    bool b_interval_changed {false};
+    Nanos last_save {0};
+
+    FleetState<Size> fleet;
+    std::shared_ptr<const ReadMap> monitor_map;
+    std::array<typename FleetState<Size>::Mask, FrameCache::max_id + 1> drive_groups {};
+    VelocityStream<Size> stream;
+    std::atomic<uint32_t> stream_acc {0};
+    std::atomic<uint32_t> stream_dec {0};
+    std::atomic<uint16_t> stream_crnt {0x03E8};
+    std::atomic<uint8_t> stream_mode {16};
+    std::array<int32_t, Size + 1> wrote_pos {};
+    SeqLock<Telemetry> telemetry;
+    std::atomic<bool> b_telemetry_dirty {false};
+
+    std::vector<std::pair<size_t, StatusListener>> status_listeners;
+    size_t listener_id {0};
+    MpscQueue<StatusEvent> status_events;
+    std::atomic<bool> b_status_events {false};
+
+    std::atomic<bool> b_suppress {false};
+    std::atomic<size_t> num_suppressed {0};
+	
+	const int32_t pos_limit_max = std::numeric_limits<int32_t>::max(); // -2,147,483,648 - 2,147,483,647 step
+	const int32_t pos_limit_min = std::numeric_limits<int32_t>::min(); // -2,147,483,648 - 2,147,483,647 step
+	const int32_t vel_limit_max { 4000000}; // -4,000,000 - 4,000,000 Hz
+	const int32_t vel_limit_min {-4000000}; // -4,000,000 - 4,000,000 Hz
+	const uint32_t acc_limit {1000000000};  // 1 - 1,000,000,000 (1=0.001kHz/s, 1=0.001s, or 1=0.001ms/kHz)
+	const uint32_t crnt_limit {0x3E8};  // 0 - 1000 (0.1% per 1)
+	const int32_t max_vel {20000};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_CONTROLLERCORE_H */
@@ -0,0 +1,180 @@
+#ifndef OFXMODBUSORIENTAL_FLEET_H
+#define OFXMODBUSORIENTAL_FLEET_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <vector>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// status flags of a drive (status register 0x7E)
+enum class StatusFlag { Tlc, Move, Busy, Alarm, Ready };
+
+// state of every drive of a bus, stored by column :
+// one bitmask per status flag (bit = motor id) and one array per value.
+// fleet wide questions are a few word operations or one straight loop over a column,
+// instead of a walk over per-motor structs
+template <size_t Size>
+class FleetState
+{
+public:
+
+    static constexpr size_t num_words = (Size + 1 + 63) / 64;
+    using Mask = std::array<uint64_t, num_words>;
+
+    FleetState() : position(), target(), velocity(), alarm_code(), load()
+    {
+        // nothing is known before the first status reply : not ready
+        for (size_t i = 1; i <= Size; ++i)
+        {
+            setBit(flags[(size_t)StatusFlag::Tlc], i, true);
+            setBit(flags[(size_t)StatusFlag::Move], i, true);
+            setBit(flags[(size_t)StatusFlag::Busy], i, true);
+            setBit(flags[(size_t)StatusFlag::Alarm], i, true);
+        }
+    }
+
+    void set(uint8_t id, StatusFlag f, bool b) { setBit(flags[(size_t)f], id, b); }
+    bool get(uint8_t id, StatusFlag f) const { return getBit(flags[(size_t)f], id); }
+
+    void setPosition(uint8_t id, int32_t p) { position[id] = p; }
+    void setTarget(uint8_t id, int32_t p) { target[id] = p; }
+    void setVelocity(uint8_t id, float v) { velocity[id] = v; }
+    int32_t getPosition(uint8_t id) const { return position[id]; }
+    int32_t getTarget(uint8_t id) const { return target[id]; }
+    float getVelocity(uint8_t id) const { return velocity[id]; }
+    // filled only by monitor reads carrying them (ControllerCore::setMonitorMap())
+    void setAlarmCode(uint8_t id, int32_t c) { alarm_code[id] = c; }
+    void setLoad(uint8_t id, int32_t l) { load[id] = l; }
+    int32_t getAlarmCode(uint8_t id) const { return alarm_code[id]; }
+    int32_t getLoad(uint8_t id) const { return load[id]; }
+
+    // ready to take a command : ready flag, and no torque limit, move, busy or alarm
+    bool ready(uint8_t id) const { return getBit(readyMask(), id); }
+
+    Mask readyMask() const
+    {
+        Mask m;
+        for (size_t w = 0; w < num_words; ++w)
+        {
+            m[w] = flags[(size_t)StatusFlag::Ready][w]
+                & ~flags[(size_t)StatusFlag::Tlc][w]
+                & ~flags[(size_t)StatusFlag::Move][w]
+                & ~flags[(size_t)StatusFlag::Busy][w]
+                & ~flags[(size_t)StatusFlag::Alarm][w];
+        }
+        return m;
+    }
+
+    const Mask& mask(StatusFlag f) const { return flags[(size_t)f]; }
+
+    bool allReady() const
+    {
+        Mask m = readyMask();
+        for (size_t w = 0; w < num_words; ++w)
+            if (m[w] != motorMask(w)) return false;
+        return true;
+    }
+
+    bool any(StatusFlag f) const
+    {
+        for (size_t w = 0; w < num_words; ++w)
+            if (flags[(size_t)f][w]) return true;
+        return false;
+    }
+
+    size_t count(StatusFlag f) const { return count(flags[(size_t)f]); }
+
+    // ids with the flag set, ascending
+    std::vector<uint8_t> ids(StatusFlag f) const { return ids(flags[(size_t)f]); }
+
+    static size_t count(const Mask& m)
+    {
+        size_t n = 0;
+        for (size_t w = 0; w < num_words; ++w) n += popcount(m[w]);
+        return n;
+    }
+
+    static std::vector<uint8_t> ids(const Mask& m)
+    {
+        std::vector<uint8_t> v;
+        for (size_t w = 0; w < num_words; ++w)
+        {
+            for (uint64_t bits = m[w]; bits; bits &= bits - 1)
+                v.push_back((uint8_t)(w * 64 + ctz(bits)));
+        }
+        return v;
+    }
+
+    // largest |target - position| over all motors, the distance still to go on the slowest axis
+    uint32_t maxPositionError() const
+    {
+        int64_t e = 0;
+        for (size_t i = 1; i <= Size; ++i)
+            e = std::max(e, std::abs((int64_t)target[i] - (int64_t)position[i]));
+        return (uint32_t)std::min<int64_t>(e, 0xFFFFFFFF);
+    }
+
+private:
+
+    static void setBit(Mask& m, size_t i, bool b)
+    {
+        uint64_t bit = (uint64_t)1 << (i % 64);
+        if (b) m[i / 64] |= bit;
+        else   m[i / 64] &= ~bit;
+    }
+    static bool getBit(const Mask& m, size_t i) { return (m[i / 64] >> (i % 64)) & 1; }
+
+    // bits 1 - Size, id 0 is broadcast
+    static uint64_t motorMask(size_t w)
+    {
+        uint64_t m = ~(uint64_t)0;
+        if (w == 0) m &= ~(uint64_t)1;
+        if (w == num_words - 1 && (Size + 1) % 64) m &= ((uint64_t)1 << ((Size + 1) % 64)) - 1;
+        return m;
+    }
+
+    static size_t popcount(uint64_t x)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        return (size_t)__popcnt64(x);
+#elif defined(__GNUC__)
+        return (size_t)__builtin_popcountll(x);
+#else
+        size_t n = 0;
+        for (; x; x &= x - 1) ++n;
+        return n;
+#endif
+    }
+
+    static size_t ctz(uint64_t x)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long i;
+        _BitScanForward64(&i, x);
+        return i;
+#elif defined(__GNUC__)
+        return (size_t)__builtin_ctzll(x);
+#else
+        size_t n = 0;
+        for (; !(x & 1); x >>= 1) ++n;
+        return n;
+#endif
+    }
+
+    std::array<Mask, 5> flags {};
+    std::array<int32_t, Size + 1> position;
+    std::array<int32_t, Size + 1> target;
+    std::array<float, Size + 1> velocity;
+    std::array<int32_t, Size + 1> alarm_code;
+    std::array<int32_t, Size + 1> load;
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_FLEET_H */
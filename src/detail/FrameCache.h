@@ -0,0 +1,72 @@
+#ifndef OFXMODBUSORIENTAL_FRAMECACHE_H
+#define OFXMODBUSORIENTAL_FRAMECACHE_H
+
+#include <vector>
+#include "Query.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// ready-to-send RemoteIOs frames with precomputed crc for every (command, id) pair.
+// the table is built once on first use (thread-safe), each command copies its frame
+// out of it : no crc per command
+class FrameCache
+{
+public:
+
+    static constexpr size_t max_id = 247; // 0 (broadcast) - 247
+
+    static Frame remoteIOs(CmdType cmd, uint8_t id)
+    {
+        int k = index(cmd);
+        if (k < 0 || id > max_id) return RemoteIOs(cmd, id).frame();
+        return table()[k * (max_id + 1) + id];
+    }
+
+    // call once at startup to keep the build (~2000 frames) out of the first stop()
+    static void warmup() { table(); }
+
+private:
+
+    static const CmdType* commands()
+    {
+        static const CmdType cmds[] {
+            CmdType::Start, CmdType::Home, CmdType::Stop, CmdType::Free,
+            CmdType::Reset, CmdType::JogFwd, CmdType::JogBwd, CmdType::Clear
+        };
+        return cmds;
+    }
+    static constexpr int num_commands = 8;
+
+    static int index(CmdType cmd)
+    {
+        for (int k = 0; k < num_commands; ++k)
+            if (commands()[k] == cmd) return k;
+        return -1;
+    }
+
+    static const std::vector<Frame>& table()
+    {
+        static const std::vector<Frame> t = build();
+        return t;
+    }
+
+    static std::vector<Frame> build()
+    {
+        std::vector<Frame> t;
+        t.reserve(num_commands * (max_id + 1));
+        for (int k = 0; k < num_commands; ++k)
+        {
+            RemoteIOs ios(commands()[k]);
+            for (size_t id = 0; id <= max_id; ++id)
+            {
+                ios.setID((uint8_t)id);
+                t.push_back(ios.frame());
+            }
+        }
+        return t;
+    }
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_FRAMECACHE_H */
@@ -0,0 +1,223 @@
+#ifndef OFXMODBUSORIENTAL_HANDLE_H
+#define OFXMODBUSORIENTAL_HANDLE_H
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// outcome of a request or a command
+struct Result
+{
+    enum class Status { Pending, Done, Exception, Timeout, Cancelled, Invalid, WriteError };
+
+    Result() {}
+    explicit Result(Status s) : status(s) {}
+
+    Status status {Status::Pending};
+    uint32_t value {0};       // decoded register value of a request
+    uint8_t exception {0};    // modbus exception code when status == Exception
+
+    bool ok() const { return status == Status::Done; }
+    int32_t asInt() const { return (int32_t)value; }
+};
+
+namespace detail
+{
+    // one per waitAll() / waitAny() call, signalled by the completions it watches
+    struct Waiter
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        void notify()
+        {
+            { std::lock_guard<std::mutex> lock(mutex); }
+            cv.notify_all();
+        }
+    };
+}
+
+// shared state between the I/O side, which resolves it, and Handles.
+// each completion has its own lock, so buses and threads don't contend on a common one
+class Completion
+{
+public:
+
+    using Callback = std::function<void(const Result&)>;
+
+    Completion() {}
+    // callback attached before the completion is shared with anyone, so without the lock
+    explicit Completion(Callback cb) : callback(std::move(cb)) {}
+
+    void resolve(Result::Status status, uint32_t value = 0, uint8_t exception = 0)
+    {
+        Callback cb;
+        std::vector<std::shared_ptr<detail::Waiter>> ws;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (b_ready.load(std::memory_order_relaxed)) return;
+            result.status = status;
+            result.value = value;
+            result.exception = exception;
+            b_ready.store(true, std::memory_order_release);
+            cb.swap(callback);
+            ws.swap(waiters);
+        }
+        for (auto& w : ws) w->notify();
+        if (cb) cb(result);
+    }
+
+    // runs on the thread which resolves, or right here when already resolved
+    void then(Callback cb)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!b_ready.load(std::memory_order_relaxed))
+            {
+                // several callbacks run in the order they were added
+                if (callback)
+                {
+                    Callback prev;
+                    prev.swap(callback);
+                    callback = [prev, cb](const Result& r) { prev(r); if (cb) cb(r); };
+                }
+                else callback = cb;
+                return;
+            }
+        }
+        if (cb) cb(result);
+    }
+
+    // lock-free, the result does not change once ready
+    bool ready() const { return b_ready.load(std::memory_order_acquire); }
+    Result get() const { return ready() ? result : Result(); }
+
+    // w is notified on resolve, nothing is added when already resolved
+    void watch(const std::shared_ptr<detail::Waiter>& w)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!b_ready.load(std::memory_order_relaxed)) waiters.push_back(w);
+    }
+    void unwatch(const detail::Waiter* w)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+            [w](const std::shared_ptr<detail::Waiter>& p) { return p.get() == w; }), waiters.end());
+    }
+
+private:
+
+    std::mutex mutex;
+    std::atomic<bool> b_ready {false};
+    Result result;
+    Callback callback;
+    std::vector<std::shared_ptr<detail::Waiter>> waiters;
+};
+
+
+class Handle
+{
+public:
+
+    Handle() {}
+    explicit Handle(std::shared_ptr<Completion> c) : completion(c) {}
+
+    static Handle resolved(Result::Status status, uint32_t value = 0)
+    {
+        Handle h(std::make_shared<Completion>());
+        h.completion->resolve(status, value);
+        return h;
+    }
+
+    bool valid() const { return (bool)completion; }
+
+    bool ready() const { return !completion || completion->ready(); }
+
+    // non-blocking, Status::Pending until resolved
+    Result result() const
+    {
+        if (!completion) return Result(Result::Status::Invalid);
+        return completion->get();
+    }
+
+    // blocks until resolved or timeout, update() must be running on another thread
+    bool wait(double timeout_sec) const;
+
+    Handle& then(Completion::Callback cb)
+    {
+        if (completion) completion->then(cb);
+        else if (cb) cb(Result(Result::Status::Invalid));
+        return *this;
+    }
+
+private:
+
+    std::shared_ptr<Completion> completion;
+
+    friend bool waitAll(const std::vector<Handle>&, double);
+    friend int waitAny(const std::vector<Handle>&, double);
+};
+
+
+namespace detail
+{
+    // blocks on a waiter of its own until pred() or timeout
+    template <typename Pred>
+    inline bool waitHandles(double timeout_sec, const std::vector<std::shared_ptr<Completion>>& cs, Pred pred)
+    {
+        auto w = std::make_shared<Waiter>();
+        for (auto& c : cs) c->watch(w);
+        bool b;
+        {
+            std::unique_lock<std::mutex> lock(w->mutex);
+            b = w->cv.wait_for(lock, std::chrono::duration<double>(timeout_sec), pred);
+        }
+        for (auto& c : cs) c->unwatch(w.get());
+        return b;
+    }
+}
+
+// blocks until every handle is resolved, false on timeout
+inline bool waitAll(const std::vector<Handle>& handles, double timeout_sec)
+{
+    std::vector<std::shared_ptr<Completion>> cs;
+    for (auto& h : handles) if (h.completion) cs.push_back(h.completion);
+    return detail::waitHandles(timeout_sec, cs, [&]
+    {
+        for (auto& c : cs) if (!c->ready()) return false;
+        return true;
+    });
+}
+
+// blocks until one of the handles is resolved, returns its index or -1 on timeout
+inline int waitAny(const std::vector<Handle>& handles, double timeout_sec)
+{
+    std::vector<std::shared_ptr<Completion>> cs;
+    for (auto& h : handles) if (h.completion) cs.push_back(h.completion);
+    int index = -1;
+    detail::waitHandles(timeout_sec, cs, [&]
+    {
+        for (size_t i = 0; i < handles.size(); ++i)
+        {
+            if (!handles[i].ready()) continue;
+            index = (int)i;
+            return true;
+        }
+        return false;
+    });
+    return index;
+}
+
+inline bool Handle::wait(double timeout_sec) const { return waitAll({ *this }, timeout_sec); }
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_HANDLE_H */
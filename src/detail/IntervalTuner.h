@@ -0,0 +1,108 @@
+#ifndef OFXMODBUSORIENTAL_INTERVALTUNER_H
+#define OFXMODBUSORIENTAL_INTERVALTUNER_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include "Utils.h"
+#include "Log.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// transmit interval auto-tuning of one bus
+// - any timeout or crc error : interval *= backoff at once
+// - a clean window of frames : interval *= (1 - decrease)
+// - an interval which failed is avoided for a while (relaxed by 1% per clean window)
+// - never below margin * the slowest round trip of the window, nor outside [min, max]
+class IntervalTuner
+{
+public:
+
+    struct Settings
+    {
+        double min_interval {0.002};
+        double max_interval {0.1};
+        double decrease {0.1};
+        double backoff {2.0};
+        double margin {1.25};
+        size_t window {20};     // frames
+    };
+
+    IntervalTuner() {}
+    explicit IntervalTuner(const Settings& s) : settings(s) {}
+
+    void setSettings(const Settings& s) { settings = s; }
+    const Settings& getSettings() const { return settings; }
+
+    // frames and errors are running totals of the bus, latency is the slowest round trip since the last call
+    // returns the interval to use from now on
+    double update(double interval, size_t frames, size_t errors, Nanos latency)
+    {
+        if (!b_started)
+        {
+            b_started = true;
+            prev_frames = frames;
+            prev_errors = errors;
+        }
+        max_latency = std::max(max_latency, latency);
+        double floor = std::max({ settings.min_interval, settings.margin * toSec(max_latency), error_floor });
+
+        if (errors != prev_errors)
+        {
+            error_floor = interval * (1.0 + settings.decrease);
+            interval = std::min(settings.max_interval, interval * settings.backoff);
+            logNotice("ofxModbusOriental") << "interval backoff to " << interval << " sec";
+            ++num_backoffs;
+            restart(frames, errors);
+        }
+        else if (frames - prev_frames >= settings.window)
+        {
+            interval = std::max(floor, interval * (1.0 - settings.decrease));
+            error_floor *= 0.99;
+            restart(frames, errors);
+        }
+        return std::min(settings.max_interval, std::max(floor, interval));
+    }
+
+    size_t getNumBackoffs() const { return num_backoffs; }
+
+    // remembers the chosen interval for the next startup
+    static bool save(const std::string& path, double interval)
+    {
+        std::ofstream ofs(path);
+        if (!ofs) return false;
+        ofs << "interval " << interval << std::endl;
+        return (bool)ofs;
+    }
+
+    static bool load(const std::string& path, double& interval)
+    {
+        std::ifstream ifs(path);
+        std::string key;
+        double value;
+        if (!(ifs >> key >> value) || key != "interval" || !(value > 0.0)) return false;
+        interval = value;
+        return true;
+    }
+
+private:
+
+    void restart(size_t frames, size_t errors)
+    {
+        prev_frames = frames;
+        prev_errors = errors;
+        max_latency = 0;
+    }
+
+    Settings settings;
+    bool b_started {false};
+    size_t prev_frames {0};
+    size_t prev_errors {0};
+    Nanos max_latency {0};
+    double error_floor {0.0};
+    size_t num_backoffs {0};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_INTERVALTUNER_H */
@@ -0,0 +1,252 @@
+#ifndef OFXMODBUSORIENTAL_IOTHREAD_H
+#define OFXMODBUSORIENTAL_IOTHREAD_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+#include "Utils.h"
+#include "Log.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// event driven I/O loop
+// sleeps until a byte arrives on the port, the next transmit slot is due, or wake() is called,
+// and then runs update() once.
+// linux : epoll + timerfd (absolute CLOCK_MONOTONIC, same clock as steady_clock) + eventfd
+// other posix : poll with a self-pipe and a millisecond timeout
+// windows : no descriptors, a condition variable and 1 ms polling
+class IoThread
+{
+public:
+
+    IoThread()
+    {
+#ifdef __linux__
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+#elif !defined(_WIN32)
+        if (pipe(pipe_fd) == 0)
+        {
+            fcntl(pipe_fd[0], F_SETFL, O_NONBLOCK);
+            fcntl(pipe_fd[1], F_SETFL, O_NONBLOCK);
+        }
+#endif
+    }
+
+    ~IoThread()
+    {
+        stop();
+#ifdef __linux__
+        if (wake_fd >= 0) ::close(wake_fd);
+        if (timer_fd >= 0) ::close(timer_fd);
+#elif !defined(_WIN32)
+        if (pipe_fd[0] >= 0) ::close(pipe_fd[0]);
+        if (pipe_fd[1] >= 0) ::close(pipe_fd[1]);
+#endif
+    }
+
+    // fd : readable descriptor of the transport, or -1 to fall back to 1 ms polling
+    // deadline : steady_clock time [ns] of the next transmit slot, or -1 when idle
+    bool start(int fd, std::function<void()> update, std::function<Nanos()> deadline)
+    {
+        if (b_running) return true;
+        this->fd = fd;
+        this->update = update;
+        this->deadline = deadline;
+        b_running = true;
+        th = std::thread(&IoThread::run, this);
+        return true;
+    }
+
+    void stop()
+    {
+        if (!b_running) return;
+        b_running = false;
+        signal();
+        if (th.joinable()) th.join();
+    }
+
+    bool isRunning() const { return b_running; }
+
+    // may be called from any thread
+    void wake() { if (b_running) signal(); }
+
+    // one wait of the loop, for callers which run update() themselves :
+    // until a byte arrives on fd or until (steady_clock [ns]), whichever comes first
+    static void waitReadable(int fd, Nanos until)
+    {
+        int timeout = (int)std::max<Nanos>(0, (until - nowNanos() + 999999) / 1000000);
+#ifndef _WIN32
+        if (fd >= 0)
+        {
+            pollfd p { fd, POLLIN, 0 };
+            ::poll(&p, 1, timeout);
+            return;
+        }
+#else
+        (void)fd;
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout, 1)));
+    }
+
+private:
+
+    void signal()
+    {
+#ifdef __linux__
+        uint64_t one = 1;
+        ssize_t r = ::write(wake_fd, &one, sizeof(one));
+#elif !defined(_WIN32)
+        uint8_t one = 1;
+        ssize_t r = ::write(pipe_fd[1], &one, sizeof(one));
+#else
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            b_woken = true;
+        }
+        wake_cv.notify_one();
+        int r = 0;
+#endif
+        (void)r;
+    }
+
+#ifdef __linux__
+
+    void run()
+    {
+        int ep = epoll_create1(EPOLL_CLOEXEC);
+        if (ep < 0)
+        {
+            logError("ofxModbusOriental") << "epoll_create1 failed";
+            b_running = false;
+            return;
+        }
+        watch(ep, wake_fd);
+        watch(ep, timer_fd);
+        if (fd >= 0) watch(ep, fd);
+
+        epoll_event events[3];
+        while (b_running)
+        {
+            update();
+            arm(deadline());
+
+            int n = epoll_wait(ep, events, 3, (fd >= 0) ? -1 : 1);
+            for (int i = 0; i < n; ++i)
+            {
+                uint64_t count;
+                ssize_t r = 0;
+                if (events[i].data.fd == wake_fd) r = ::read(wake_fd, &count, sizeof(count));
+                else if (events[i].data.fd == timer_fd) r = ::read(timer_fd, &count, sizeof(count));
+                else if (events[i].events & (EPOLLHUP | EPOLLERR))
+                {
+                    logError("ofxModbusOriental") << "port hung up, falling back to polling";
+                    epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+                    fd = -1;
+                }
+                (void)r;
+            }
+        }
+        ::close(ep);
+    }
+
+    static void watch(int ep, int target)
+    {
+        epoll_event ev {};
+        ev.events = EPOLLIN;
+        ev.data.fd = target;
+        epoll_ctl(ep, EPOLL_CTL_ADD, target, &ev);
+    }
+
+    void arm(Nanos due)
+    {
+        itimerspec its {};
+        if (due >= 0)
+        {
+            if (due == 0) due = 1; // zero would disarm
+            its.it_value.tv_sec = due / 1000000000;
+            its.it_value.tv_nsec = due % 1000000000;
+        }
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+    int wake_fd {-1};
+    int timer_fd {-1};
+
+#elif !defined(_WIN32)
+
+    void run()
+    {
+        while (b_running)
+        {
+            update();
+            Nanos due = deadline();
+
+            int timeout = -1;
+            if (due >= 0) timeout = (int)std::max<Nanos>(0, (due - nowNanos() + 999999) / 1000000);
+            if (fd < 0 && (timeout < 0 || timeout > 1)) timeout = 1;
+
+            pollfd fds[2] { { pipe_fd[0], POLLIN, 0 }, { fd, POLLIN, 0 } };
+            int n = ::poll(fds, (fd >= 0) ? 2 : 1, timeout);
+            if (n > 0 && (fds[0].revents & POLLIN))
+            {
+                uint8_t buf[64];
+                while (::read(pipe_fd[0], buf, sizeof(buf)) > 0);
+            }
+            if (n > 0 && fd >= 0 && (fds[1].revents & (POLLHUP | POLLERR)))
+            {
+                logError("ofxModbusOriental") << "port hung up, falling back to polling";
+                fd = -1;
+            }
+        }
+    }
+
+    int pipe_fd[2] {-1, -1};
+
+#else
+
+    void run()
+    {
+        while (b_running)
+        {
+            update();
+            Nanos due = deadline();
+            Nanos until = nowNanos() + 1000000;
+            if (due >= 0) until = std::min(due, until);
+
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cv.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::nanoseconds(until)), [this] { return b_woken; });
+            b_woken = false;
+        }
+    }
+
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    bool b_woken {false};
+
+#endif
+
+    int fd {-1};
+    std::thread th;
+    std::atomic<bool> b_running {false};
+    std::function<void()> update;
+    std::function<Nanos()> deadline;
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_IOTHREAD_H */
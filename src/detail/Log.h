@@ -0,0 +1,57 @@
+#ifndef OFXMODBUSORIENTAL_LOG_H
+#define OFXMODBUSORIENTAL_LOG_H
+
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// logging sink of the core
+// default sink prints warnings and errors to stderr,
+// the openFrameworks Controller redirects everything to ofLog
+
+enum class LogLevel { Verbose, Notice, Warning, Error };
+
+using LogSink = std::function<void(LogLevel, const std::string& module, const std::string& message)>;
+
+inline LogSink& logSink()
+{
+    static LogSink sink = [](LogLevel level, const std::string& module, const std::string& message)
+    {
+        if (level < LogLevel::Warning) return;
+        std::cerr << "[" << module << "] " << message << std::endl;
+    };
+    return sink;
+}
+
+inline void setLogSink(LogSink sink) { logSink() = sink; }
+
+class LogMessage
+{
+public:
+
+    LogMessage(LogLevel level, const std::string& module) : level(level), module(module) {}
+    LogMessage(LogMessage&& other) : level(other.level), module(std::move(other.module)), ss(std::move(other.ss)) { other.b_moved = true; }
+    ~LogMessage() { if (!b_moved && logSink()) logSink()(level, module, ss.str()); }
+
+    template <typename T>
+    LogMessage& operator<< (const T& value) { ss << value; return *this; }
+
+private:
+
+    LogLevel level;
+    std::string module;
+    std::ostringstream ss;
+    bool b_moved {false};
+};
+
+inline LogMessage logVerbose(const std::string& module) { return LogMessage(LogLevel::Verbose, module); }
+inline LogMessage logNotice(const std::string& module) { return LogMessage(LogLevel::Notice, module); }
+inline LogMessage logWarning(const std::string& module) { return LogMessage(LogLevel::Warning, module); }
+inline LogMessage logError(const std::string& module) { return LogMessage(LogLevel::Error, module); }
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_LOG_H */
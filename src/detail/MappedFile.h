@@ -0,0 +1,88 @@
+#ifndef OFXMODBUSORIENTAL_MAPPEDFILE_H
+#define OFXMODBUSORIENTAL_MAPPEDFILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// read-only view of a whole file for the capture and show readers.
+// posix : mmap, pages come in on demand. windows : the file is read into memory
+class MappedFile
+{
+public:
+
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifndef _WIN32
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) { close(); return false; }
+        length = (size_t)st.st_size;
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { close(); return false; }
+        head = (const uint8_t*)p;
+#else
+        std::ifstream f(path, std::ios::binary);
+        if (!f) return false;
+        bytes.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        if (bytes.empty()) return false;
+        head = bytes.data();
+        length = bytes.size();
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        if (head) munmap((void*)head, length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#else
+        bytes.clear();
+#endif
+        head = nullptr;
+        length = 0;
+    }
+
+    // read front to back, the kernel may read ahead
+    void sequential()
+    {
+#ifndef _WIN32
+        if (head) madvise((void*)head, length, MADV_SEQUENTIAL);
+#endif
+    }
+
+    const uint8_t* data() const { return head; }
+    size_t size() const { return length; }
+
+private:
+
+#ifndef _WIN32
+    int fd {-1};
+#else
+    std::vector<uint8_t> bytes;
+#endif
+    const uint8_t* head {nullptr};
+    size_t length {0};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_MAPPEDFILE_H */
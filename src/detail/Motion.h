@@ -0,0 +1,223 @@
+#ifndef OFXMODBUSORIENTAL_MOTION_H
+#define OFXMODBUSORIENTAL_MOTION_H
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include "Utils.h"
+#include "Log.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// motion parameters of one positioning operation
+struct Profile
+{
+    int32_t pos {0};
+    int32_t vel {0};
+    uint32_t acc {0};
+    uint32_t dec {0};
+    uint8_t mode {0x01};
+    uint16_t crnt {0x03E8};
+
+    Profile() {}
+    Profile(int32_t pos, int32_t vel, uint32_t acc, uint32_t dec, uint8_t mode = 0x01, uint16_t crnt = 0x03E8)
+    : pos(pos), vel(vel), acc(acc), dec(dec), mode(mode), crnt(crnt) {}
+
+    bool operator== (const Profile& p) const
+    {
+        return pos == p.pos && vel == p.vel && acc == p.acc && dec == p.dec && mode == p.mode && crnt == p.crnt;
+    }
+};
+
+// the profile setMotionTriangle() writes : from from to to in time [s], accelerating for the first
+// half and decelerating for the second (the velocity limit vel_max is not reached).
+// slow moves (|average| <= 500 step/s) run at constant speed with acc_max instead
+inline Profile triangleProfile(int32_t from, int32_t to, float time, int32_t vel_max, uint32_t acc_max)
+{
+    float diff_pos = (float)((float)to - (float)from);
+    float avg_vel = diff_pos / time;
+    float vel = 0.f;
+    float acc = 0.f;
+    if (std::abs(avg_vel) <= 500.f)
+    {
+        vel = avg_vel;
+        acc = acc_max;
+        logWarning("ofxModbusOriental") << "low speed : constant speed operation";
+    }
+    else
+    {
+        vel = vel_max; // 2.f * avg_vel
+        acc = 4.f * avg_vel / time;
+    }
+    return Profile(to, (int32_t)vel, (uint32_t)std::abs(acc), (uint32_t)std::abs(acc));
+}
+
+// host-side dead-reckoning of every axis between position polls.
+// each commanded move is modelled as a trapezoid (accelerate, cruise, decelerate) from the
+// estimated position and velocity at its start, and every position reply re-anchors the model.
+// mode 1 (absolute) and 2 (incremental) are modelled, other modes hold the last position.
+template <size_t Size>
+class MotionEstimator
+{
+public:
+
+    struct Error
+    {
+        double last {0.0}; // estimate - reply of the last position reply [step]
+        double max {0.0};  // max |last| since reset()
+        double sum_sq {0.0};
+        size_t count {0};
+
+        double rms() const { return count ? std::sqrt(sum_sq / count) : 0.0; }
+    };
+
+    // drive acceleration unit in step/s^2, 1 by default (0.001 kHz/s)
+    void setAccelerationUnit(double steps_per_sec2) { acc_unit = steps_per_sec2; }
+
+    void command(uint8_t id, const Profile& p, Nanos t)
+    {
+        Segment& s = segments[id];
+        double x = position(s, t);
+        double v = velocity(s, t);
+        double target;
+        if (p.mode == 0x01) target = p.pos;
+        else if (p.mode == 0x02) target = s.target + p.pos; // from the command position
+        else target = x;
+        start(s, x, v, target, std::abs((double)p.vel), p.acc * acc_unit, p.dec * acc_unit, t);
+    }
+
+    // decelerate to a stop with the current deceleration
+    void halt(uint8_t id, Nanos t)
+    {
+        Segment& s = segments[id];
+        double x = position(s, t);
+        double v = velocity(s, t);
+        double stop = (s.dec > 0.0) ? v * std::abs(v) / (2.0 * s.dec) : 0.0;
+        start(s, x, v, x + stop, s.vmax, s.acc, s.dec, t);
+    }
+
+    // a measured position at time t
+    void anchor(uint8_t id, int32_t pos, Nanos t)
+    {
+        Segment& s = segments[id];
+        if (s.b_valid)
+        {
+            Error& e = errors[id];
+            e.last = position(s, t) - pos;
+            e.max = std::max(e.max, std::abs(e.last));
+            e.sum_sq += e.last * e.last;
+            ++e.count;
+        }
+        // a finished move stays where the drive reports, a running one keeps its target
+        bool b_moving = s.b_valid && toSec(t - s.t0) < s.td;
+        double v = velocity(s, t);
+        start(s, pos, v, (b_moving ? s.target : (double)pos), s.vmax, s.acc, s.dec, t);
+        s.b_valid = true;
+    }
+
+    double getPosition(uint8_t id, Nanos t) const { return position(segments[id], t); }
+    double getVelocity(uint8_t id, Nanos t) const { return velocity(segments[id], t); }
+    double getTarget(uint8_t id) const { return segments[id].target; }
+    const Error& getError(uint8_t id) const { return errors[id]; }
+
+    void reset(uint8_t id)
+    {
+        if (id == 0) for (auto& e : errors) e = Error();
+        else errors[id] = Error();
+    }
+
+private:
+
+    struct Segment
+    {
+        Nanos t0 {0};
+        double x0 {0.0};
+        double target {0.0};
+        double dir {1.0};
+        double v0 {0.0};   // toward the target, >= 0
+        double vp {0.0};   // peak velocity
+        double vmax {0.0};
+        double acc {0.0};
+        double dec {0.0};
+        double ta {0.0};   // end of acceleration [s]
+        double tc {0.0};   // end of cruise [s]
+        double td {0.0};   // end of motion [s]
+        double xa {0.0};   // distance at ta
+        double xc {0.0};   // distance at tc
+        bool b_valid {false}; // anchored at least once
+    };
+
+    static void start(Segment& s, double x, double v, double target, double vmax, double acc, double dec, Nanos t)
+    {
+        s.t0 = t;
+        s.x0 = x;
+        s.target = target;
+        s.vmax = vmax;
+        s.acc = acc;
+        s.dec = dec;
+
+        double d = target - x;
+        s.dir = (d < 0.0) ? -1.0 : 1.0;
+        double dist = std::abs(d);
+        // moving away from the target is treated as starting from rest
+        double v0 = std::max(0.0, v * s.dir);
+        double a = (acc > 0.0) ? acc : 1e12; // 0 : as fast as possible
+        double b = (dec > 0.0) ? dec : 1e12;
+        if (vmax <= 0.0 || dist <= 0.0)
+        {
+            s.v0 = s.vp = 0.0;
+            s.ta = s.tc = s.td = 0.0;
+            s.xa = s.xc = 0.0;
+            return;
+        }
+        s.acc = a;
+        s.dec = b;
+        v0 = std::min(v0, std::sqrt(2.0 * b * dist));
+
+        double vp = vmax;
+        if ((vp * vp - v0 * v0) / (2.0 * a) + vp * vp / (2.0 * b) > dist)
+            vp = std::sqrt((2.0 * a * b * dist + b * v0 * v0) / (a + b));
+        vp = std::max(vp, v0);
+
+        s.v0 = v0;
+        s.vp = vp;
+        s.ta = (vp - v0) / a;
+        s.xa = (vp * vp - v0 * v0) / (2.0 * a);
+        double xd = vp * vp / (2.0 * b);
+        s.tc = s.ta + std::max(0.0, dist - s.xa - xd) / vp;
+        s.xc = std::max(s.xa, dist - xd);
+        s.td = s.tc + vp / b;
+    }
+
+    static double position(const Segment& s, Nanos t)
+    {
+        double dt = toSec(t - s.t0);
+        double x;
+        if (dt <= 0.0) x = 0.0;
+        else if (dt < s.ta) x = s.v0 * dt + 0.5 * s.acc * dt * dt;
+        else if (dt < s.tc) x = s.xa + s.vp * (dt - s.ta);
+        else if (dt < s.td) { double r = dt - s.tc; x = s.xc + s.vp * r - 0.5 * s.dec * r * r; }
+        else return s.target;
+        return s.x0 + s.dir * std::min(x, std::abs(s.target - s.x0));
+    }
+
+    static double velocity(const Segment& s, Nanos t)
+    {
+        double dt = toSec(t - s.t0);
+        double v;
+        if (dt < 0.0 || dt >= s.td) v = 0.0;
+        else if (dt < s.ta) v = s.v0 + s.acc * dt;
+        else if (dt < s.tc) v = s.vp;
+        else v = s.vp - s.dec * (dt - s.tc);
+        return s.dir * std::max(0.0, v);
+    }
+
+    std::array<Segment, Size + 1> segments;
+    std::array<Error, Size + 1> errors;
+    double acc_unit {1.0};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_MOTION_H */
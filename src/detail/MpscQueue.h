@@ -0,0 +1,66 @@
+#ifndef OFXMODBUSORIENTAL_MPSCQUEUE_H
+#define OFXMODBUSORIENTAL_MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// unbounded lock-free queue, many producers and one consumer (D. Vyukov's node based queue)
+// push() is wait-free and may be called from any thread,
+// pop() must only be called from the consumer thread
+template <typename T>
+class MpscQueue
+{
+    struct Node
+    {
+        std::atomic<Node*> next {nullptr};
+        T value;
+    };
+
+public:
+
+    MpscQueue() : head(&stub), tail(&stub) {}
+
+    ~MpscQueue()
+    {
+        T v;
+        while (pop(v));
+        if (tail != &stub) delete tail;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator= (const MpscQueue&) = delete;
+
+    void push(T&& v)
+    {
+        Node* n = new Node;
+        n->value = std::move(v);
+        Node* prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // an item whose producer is between exchange() and store() is not visible yet,
+    // it will be on the next call
+    bool pop(T& v)
+    {
+        Node* t = tail;
+        Node* next = t->next.load(std::memory_order_acquire);
+        if (!next) return false;
+        v = std::move(next->value);
+        next->value = T();
+        tail = next;
+        if (t != &stub) delete t;
+        return true;
+    }
+
+private:
+
+    std::atomic<Node*> head;
+    Node* tail;
+    Node stub;
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_MPSCQUEUE_H */
@@ -0,0 +1,248 @@
+#ifndef OFXMODBUSORIENTAL_PARAMETERS_H
+#define OFXMODBUSORIENTAL_PARAMETERS_H
+
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ControllerCore.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// register values of many drives, keyed by (id, register address)
+class ParameterSnapshot
+{
+public:
+
+    void set(uint8_t id, uint16_t addr, uint16_t value) { regs[key(id, addr)] = value; }
+
+    bool get(uint8_t id, uint16_t addr, uint16_t& value) const
+    {
+        auto it = regs.find(key(id, addr));
+        if (it == regs.end()) return false;
+        value = it->second;
+        return true;
+    }
+
+    bool has(uint8_t id, uint16_t addr) const { return regs.count(key(id, addr)) > 0; }
+    size_t size() const { return regs.size(); }
+    bool empty() const { return regs.empty(); }
+    void clear() { regs.clear(); }
+
+    // the registers of target which this snapshot lacks or holds with another value
+    ParameterSnapshot diff(const ParameterSnapshot& target) const
+    {
+        ParameterSnapshot d;
+        for (auto& r : target.regs)
+        {
+            auto it = regs.find(r.first);
+            if (it == regs.end() || it->second != r.second) d.regs.insert(r);
+        }
+        return d;
+    }
+
+    // calls f(id, addr, value) in id and address order
+    template <typename F>
+    void forEach(F f) const
+    {
+        for (auto& r : regs) f((uint8_t)(r.first >> 16), (uint16_t)(r.first & 0xFFFF), r.second);
+    }
+
+    // one "id address value" line per register, hex, diffable as text
+    bool save(const std::string& path) const
+    {
+        std::ofstream ofs(path);
+        if (!ofs) return false;
+        ofs << "# ofxModbusOriental parameters : id address value" << std::endl;
+        ofs << std::hex << std::setfill('0');
+        for (auto& r : regs)
+        {
+            ofs << std::setw(2) << (r.first >> 16) << " "
+                << std::setw(4) << (r.first & 0xFFFF) << " "
+                << std::setw(4) << r.second << "\n";
+        }
+        return (bool)ofs;
+    }
+
+    bool load(const std::string& path)
+    {
+        std::ifstream ifs(path);
+        if (!ifs) return false;
+        regs.clear();
+        std::string line;
+        while (std::getline(ifs, line))
+        {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream iss(line);
+            unsigned id, addr, value;
+            if (!(iss >> std::hex >> id >> addr >> value) || id > 0xFF || addr > 0xFFFF || value > 0xFFFF)
+            {
+                logError("ofxModbusOriental") << "invalid parameter line : " << line;
+                return false;
+            }
+            set((uint8_t)id, (uint16_t)addr, (uint16_t)value);
+        }
+        return true;
+    }
+
+private:
+
+    static uint32_t key(uint8_t id, uint16_t addr) { return ((uint32_t)id << 16) | addr; }
+
+    std::map<uint32_t, uint16_t> regs;
+};
+
+
+// bulk parameter dump and restore.
+// read() splits a register range into block reads of up to 124 registers and queues them all at once,
+// so the bus runs them back to back instead of one register pair per round trip.
+// restore() writes only the registers of a target which differ from what was read,
+// merged into contiguous runs of up to 122 registers.
+// drive parameters are 32 bit (upper, lower register at an even address), so ranges are widened
+// to whole pairs and a pair is always written as a whole.
+// drives answer one frame at a time, so buses are the unit of parallelism :
+// one ParameterDump per ControllerCore, each running on startThread().
+// call from the app thread, poll() or getSnapshot() once the returned handles are ready
+template <size_t Size>
+class ParameterDump
+{
+    struct Pending
+    {
+        uint8_t id;
+        uint16_t addr;
+        Handle handle;
+        std::shared_ptr<std::vector<uint16_t>> values; // read : filled by the reply, write : what was sent
+        bool b_write;
+    };
+
+public:
+
+    static constexpr uint16_t max_read = 124;
+    static constexpr uint16_t max_write = 122;
+
+    explicit ParameterDump(ControllerCore<Size>& core) : core(core) {}
+
+    // id 0 : every motor. the range is widened to whole pairs
+    std::vector<Handle> read(uint8_t id, uint16_t addr, uint32_t count)
+    {
+        uint32_t end = std::min<uint32_t>((addr + count + 1) & ~1u, 0x10000);
+        addr &= ~1;
+        count = end - addr;
+        std::vector<Handle> handles;
+        forEachId(id, [&](uint8_t i)
+        {
+            for (uint32_t offset = 0; offset < count; offset += max_read)
+            {
+                uint16_t n = (uint16_t)std::min<uint32_t>(max_read, count - offset);
+                auto out = std::make_shared<std::vector<uint16_t>>();
+                Handle h = core.readRegisters(i, (uint16_t)(addr + offset), n, out);
+                pending.push_back({ i, (uint16_t)(addr + offset), h, out, false });
+                handles.push_back(h);
+            }
+        });
+        return handles;
+    }
+
+    // writes the registers of target which differ from the snapshot (missing ones included)
+    std::vector<Handle> restore(const ParameterSnapshot& target)
+    {
+        poll();
+        std::vector<Handle> handles;
+        uint8_t run_id = 0;
+        uint16_t run_addr = 0;
+        std::vector<uint16_t> run;
+        auto flush = [&]()
+        {
+            if (run.empty()) return;
+            auto values = std::make_shared<std::vector<uint16_t>>(run);
+            Handle h = core.writeRegisters(run_id, run_addr, run);
+            pending.push_back({ run_id, run_addr, h, values, true });
+            handles.push_back(h);
+            run.clear();
+        };
+        pairs(target).forEach([&](uint8_t id, uint16_t addr, uint16_t value)
+        {
+            bool b_next = !run.empty() && id == run_id && addr == run_addr + run.size() && run.size() < max_write;
+            if (!b_next)
+            {
+                flush();
+                run_id = id;
+                run_addr = addr;
+            }
+            run.push_back(value);
+        });
+        flush();
+        return handles;
+    }
+
+    // merges finished reads and confirmed writes into the snapshot,
+    // returns the number of blocks still in flight
+    size_t poll()
+    {
+        auto done = std::partition(pending.begin(), pending.end(), [](const Pending& p) { return !p.handle.ready(); });
+        for (auto it = done; it != pending.end(); ++it)
+        {
+            if (!it->handle.result().ok())
+            {
+                ++num_failed;
+                continue;
+            }
+            for (size_t k = 0; k < it->values->size(); ++k)
+                snapshot.set(it->id, (uint16_t)(it->addr + k), (*it->values)[k]);
+        }
+        pending.erase(done, pending.end());
+        return pending.size();
+    }
+
+    const ParameterSnapshot& getSnapshot() { poll(); return snapshot; }
+    void setSnapshot(const ParameterSnapshot& s) { snapshot = s; }
+    void clear() { snapshot.clear(); num_failed = 0; }
+
+    // blocks which timed out or were answered with an exception, pairs which could not be restored
+    size_t getNumFailed() const { return num_failed; }
+
+private:
+
+    // the differing registers of target, completed to whole pairs. the other half comes from
+    // target, else from the snapshot. a pair with an unknown half is not written
+    ParameterSnapshot pairs(const ParameterSnapshot& target)
+    {
+        ParameterSnapshot p;
+        snapshot.diff(target).forEach([&](uint8_t id, uint16_t addr, uint16_t)
+        {
+            uint16_t lo = addr & ~1, v[2];
+            for (uint16_t k = 0; k < 2; ++k)
+            {
+                if (target.get(id, lo + k, v[k]) || snapshot.get(id, lo + k, v[k])) continue;
+                logError("ofxModbusOriental") << "restore : half of parameter " << std::hex << lo << std::dec << " of " << (int)id
+                    << " is unknown, not written";
+                ++num_failed;
+                return;
+            }
+            p.set(id, lo, v[0]);
+            p.set(id, lo + 1, v[1]);
+        });
+        return p;
+    }
+
+    template <typename F>
+    void forEachId(uint8_t id, F f)
+    {
+        if (id != 0) f(id);
+        else for (size_t i = 1; i <= Size; ++i) f((uint8_t)i);
+    }
+
+    ControllerCore<Size>& core;
+    ParameterSnapshot snapshot;
+    std::vector<Pending> pending;
+    size_t num_failed {0};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_PARAMETERS_H */
@@ -2,7 +2,9 @@
 #define OFXMODBUSORIENTAL_PARSER_H
 
 #include <queue>
+#include <vector>
 #include "Utils.h"
+#include "Log.h"
 
 OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
 
@@ -17,8 +19,13 @@ public:
         uint8_t addr;
         uint8_t func;
         uint8_t size;
-        vector<uint8_t> data;
+        std::vector<uint8_t> data;
         uint16_t crc;
+        Nanos first_byte {0};   // arrival of the chunk holding the first byte, when fed with a time
+        Nanos complete {0};     // crc checked
+        
+        bool isException() const { return func & 0x80; }
+        uint8_t function() const { return func & 0x7F; }
     };
     
     size_t available() { return _readBuffer.size(); }
@@ -29,9 +36,14 @@ public:
     
     const Response& front() const { return _readBuffer.front(); }
     
-    void feed(const uint8_t* const data, const size_t size)
+    size_t getNumCrcErrors() const { return num_crc_errors; }
+    
+    // time : when the chunk was read, 0 skips the timestamps
+    void feed(const uint8_t* const data, const size_t size, Nanos time = 0)
     {
+        chunk_time = time;
         for (size_t i = 0; i < size; ++i) feed(data[i]);
+        chunk_time = 0;
     }
     
     void feed(uint8_t data)
@@ -42,6 +54,7 @@ public:
             {
                 reset();
                 r_buffer.addr = data;
+                r_buffer.first_byte = chunk_time;
                 crc.push(data);
                 state = State::Func;
                 break;
@@ -50,7 +63,19 @@ public:
             {
                 r_buffer.func = data;
                 crc.push(data);
-                state = State::Size;
+                if (data & 0x80)
+                {
+                    // exception : function | 0x80, exception code
+                    r_buffer.size = 1;
+                    state = State::Data;
+                }
+                else if (data == 0x06 || data == 0x10)
+                {
+                    // write echo : register address + register count (or value)
+                    r_buffer.size = 4;
+                    state = State::Data;
+                }
+                else state = State::Size;
                 break;
             }
             case State::Size:
@@ -74,8 +99,16 @@ public:
                 
                 if (++crc_count >= 2)
                 {
-                    if (r_buffer.crc == crc.get()) _readBuffer.push(r_buffer);
-                    else ofLogError("invalid checksum") << (int)r_buffer.crc << " & " << (int)crc.get() << endl;
+                    if (r_buffer.crc == crc.get())
+                    {
+                        r_buffer.complete = chunk_time ? nowNanos() : 0;
+                        _readBuffer.push(r_buffer);
+                    }
+                    else
+                    {
+                        logError("ofxModbusOriental") << "invalid checksum " << (int)r_buffer.crc << " & " << (int)crc.get();
+                        ++num_crc_errors;
+                    }
                     reset();
                 }
                 break;
@@ -95,18 +128,21 @@ private:
     {
         r_buffer.addr = r_buffer.func = r_buffer.size = 0;
         r_buffer.data.clear();
+        r_buffer.first_byte = r_buffer.complete = 0;
         crc.clear();
         count = crc_count = 0;
         state = State::Addr;
     }
     
-    queue<Response> _readBuffer;
+    std::queue<Response> _readBuffer;
     
     Response r_buffer;
     CrcGenerator crc;
     uint8_t count {0};
     uint8_t crc_count {0};
     State state = State::Addr;
+    size_t num_crc_errors {0};
+    Nanos chunk_time {0};
     
 };
 
@@ -0,0 +1,124 @@
+#ifndef OFXMODBUSORIENTAL_PROGRAMCACHE_H
+#define OFXMODBUSORIENTAL_PROGRAMCACHE_H
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "ControllerCore.h"
+#include "Motion.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// keeps frequently used profiles in the drives' data numbers.
+// the first move of a profile uploads it to the least recently used slot of that drive (33 bytes),
+// repeats are data_no() + start() + clear() only. with write suppression enabled on the core,
+// data_no() is skipped as well when the drive has already selected that number.
+// uploads live in drive RAM, call invalidate() after a drive power cycle.
+// call from the update() thread
+template <size_t Size>
+class ProgramCache
+{
+    struct Slot
+    {
+        Profile profile;
+        uint64_t last_use {0};
+        bool b_used {false};
+    };
+
+public:
+
+    // data numbers [first_no, first_no + num_slots) are reserved for the cache on every drive
+    ProgramCache(ControllerCore<Size>& core, uint8_t first_no = 0, uint8_t num_slots = 8)
+    : core(core), first_no(first_no)
+    {
+        size_t n = std::min<size_t>(std::max<size_t>(num_slots, 1), 256 - first_no);
+        for (auto& s : slots) s.assign(n, Slot());
+    }
+
+    // resolves when the start frame is echoed
+    Handle move(uint8_t id, const Profile& p)
+    {
+        if (!select(id, p).valid()) return Handle::resolved(Result::Status::Invalid);
+        Handle h = core.start(id, p);
+        core.clear(id);
+        return h;
+    }
+
+    // uploads if needed and selects the data number, without starting.
+    // select every drive and start(0) + clear(0) to run them together
+    Handle select(uint8_t id, const Profile& p)
+    {
+        if (id == 0 || id > Size)
+        {
+            logError("ofxModbusOriental") << "ProgramCache needs a unicast id, got " << (int)id;
+            return Handle();
+        }
+        std::vector<Slot>& drive = slots[id];
+        size_t k = find(drive, p);
+        if (k < drive.size())
+        {
+            ++num_hits;
+        }
+        else
+        {
+            k = victim(drive);
+            drive[k].profile = p;
+            drive[k].b_used = true;
+            core.writeOperationData(id, first_no + k, p.pos, p.vel, p.acc, p.dec, p.mode, p.crnt)
+                .then([this, id, k, p](const Result& r)
+                {
+                    // the drive may hold anything now
+                    if (!r.ok() && slots[id][k].profile == p) slots[id][k].b_used = false;
+                });
+            ++num_uploads;
+        }
+        drive[k].last_use = ++clock;
+        return core.data_no(first_no + k, id);
+    }
+
+    // forget what drive id holds, 0 forgets every drive
+    void invalidate(uint8_t id = 0)
+    {
+        for (size_t i = 0; i < slots.size(); ++i)
+        {
+            if (id != 0 && i != id) continue;
+            for (auto& s : slots[i]) s = Slot();
+        }
+    }
+
+    size_t getNumHits() const { return num_hits; }
+    size_t getNumUploads() const { return num_uploads; }
+
+private:
+
+    static size_t find(const std::vector<Slot>& drive, const Profile& p)
+    {
+        for (size_t k = 0; k < drive.size(); ++k)
+            if (drive[k].b_used && drive[k].profile == p) return k;
+        return drive.size();
+    }
+
+    // an empty slot, otherwise the least recently used one
+    static size_t victim(const std::vector<Slot>& drive)
+    {
+        size_t k = 0;
+        for (size_t i = 0; i < drive.size(); ++i)
+        {
+            if (!drive[i].b_used) return i;
+            if (drive[i].last_use < drive[k].last_use) k = i;
+        }
+        return k;
+    }
+
+    ControllerCore<Size>& core;
+    uint8_t first_no;
+    std::array<std::vector<Slot>, Size + 1> slots;
+    uint64_t clock {0};
+    size_t num_hits {0};
+    size_t num_uploads {0};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_PROGRAMCACHE_H */
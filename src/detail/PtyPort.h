@@ -0,0 +1,79 @@
+#ifndef OFXMODBUSORIENTAL_PTYPORT_H
+#define OFXMODBUSORIENTAL_PTYPORT_H
+
+#include <string>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "Transport.h"
+#include "Log.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// master side of a pseudo terminal.
+// a drive simulator, or a bridge such as socat, opens getSlaveName() like a serial port.
+class PtyPort : public Transport
+{
+public:
+
+    PtyPort() {}
+    virtual ~PtyPort() { close(); }
+
+    bool open()
+    {
+        close();
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+        {
+            logError("ofxModbusOriental") << "could not open pty";
+            close();
+            return false;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        termios tio;
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+
+        const char* name = ptsname(fd);
+        slave_name = name ? name : "";
+        return true;
+    }
+
+    const std::string& getSlaveName() const { return slave_name; }
+
+    virtual bool isOpen() override { return fd >= 0; }
+
+    virtual size_t available() override
+    {
+        int n = 0;
+        if (fd < 0 || ioctl(fd, FIONREAD, &n) != 0) return 0;
+        return (size_t)n;
+    }
+
+    virtual long read(uint8_t* data, size_t size) override { return (fd < 0) ? -1 : ::read(fd, data, size); }
+
+    virtual long write(const uint8_t* data, size_t size) override { return (fd < 0) ? -1 : ::write(fd, data, size); }
+
+    virtual void close() override
+    {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        slave_name.clear();
+    }
+
+    virtual int getFd() override { return fd; }
+
+private:
+
+    int fd {-1};
+    std::string slave_name;
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_PTYPORT_H */
@@ -3,7 +3,10 @@
 
 #include <cstdint>
 #include <array>
+#include <vector>
+#include <algorithm>
 #include "Utils.h"
+#include "RegisterMap.h"
 
 OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
 
@@ -22,36 +25,82 @@ enum class CmdType
 };
 
 
-class Query
+// the largest frame on the bus : a write multiple of max_write_regs registers
+constexpr size_t max_write_regs = 123;
+constexpr size_t max_frame_size = writeFrameSize(max_write_regs);
+
+// a frame ready to go out, by value : its bytes, crc included, and their count.
+// what the queues of Stream hold and copy, so a command allocates nothing and nothing is
+// shared between the thread which built it and the update() thread
+class Frame
 {
 public:
-	virtual uint8_t* data() = 0;
-	virtual size_t size() = 0;
-    virtual uint32_t at(uint8_t id) = 0;
-	virtual uint32_t operator[](uint8_t id) = 0;
-    virtual void setID(uint8_t id) = 0;
+    
+    Frame() {}
+    
+    // size bytes, the last two of them the crc of the others, computed here
+    Frame(const uint8_t* data, size_t size) : Frame(data, size, data[0]) {}
+    
+    // the same frame to id
+    Frame(const uint8_t* data, size_t size, uint8_t id) : length((uint16_t)std::min(size, max_frame_size))
+    {
+        std::copy(data, data + length, bytes.begin());
+        bytes[0] = id;
+        setCrc();
+    }
+    
+    const uint8_t* data() const { return bytes.data(); }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    uint8_t getID() const { return bytes[0]; }
+    
+    void setID(uint8_t id)
+    {
+        bytes[0] = id;
+        setCrc();
+    }
+    
+private:
+    
+    void setCrc()
+    {
+        if (length < 4) return;
+        uint16_t c = crc16(bytes.data(), length - 2);
+        bytes[length - 2] = c & 0xFF;
+        bytes[length - 1] = c >> 8;
+    }
+    
+    std::array<uint8_t, max_frame_size> bytes;
+    uint16_t length {0};
 };
 
+// frame of a fixed layout, encoded in place through the descriptors of RegisterMap.h.
+// no virtual dispatch : frame() hands out the bytes with their crc as a Frame
 template <size_t Size>
-class QueryImpl : public Query
+class FixedFrame
 {
 public:
 	
-    virtual uint8_t* data() override { setCrc(); return query.data(); }
-    virtual size_t size() override { return query.size(); }
-    virtual uint32_t at(uint8_t id) override
+    static_assert(Size >= 8 && Size <= max_frame_size, "frame size out of range");
+    static constexpr uint8_t val_offset = 7;
+    
+    Frame frame() const { return Frame(query.data(), Size); }
+    Frame frame(uint8_t id) const { return Frame(query.data(), Size, id); }
+    
+    uint32_t at(uint8_t id) const
     {
         uint32_t data = 0;
         size_t offset = id * sizeof(uint32_t) + val_offset;
-        data |= (uint32_t)((query.data()[offset + 0] << 24) & 0xFF000000);
-        data |= (uint32_t)((query.data()[offset + 1] << 16) & 0x00FF0000);
-        data |= (uint32_t)((query.data()[offset + 2] <<  8) & 0x0000FF00);
-        data |= (uint32_t)((query.data()[offset + 3] <<  0) & 0x000000FF);
+        data |= (uint32_t)((query[offset + 0] << 24) & 0xFF000000);
+        data |= (uint32_t)((query[offset + 1] << 16) & 0x00FF0000);
+        data |= (uint32_t)((query[offset + 2] <<  8) & 0x0000FF00);
+        data |= (uint32_t)((query[offset + 3] <<  0) & 0x000000FF);
         return data;
     }
-    virtual uint32_t operator[](uint8_t id) override { return at(id); }
+    uint32_t operator[](uint8_t id) const { return at(id); }
 	
-    virtual void setID(uint8_t id) override { query[0] = id; }
+    uint8_t getID() const { return query[0]; }
+    void setID(uint8_t id) { query[0] = id; }
 	
     void setFunc(uint8_t func) { query[1] = func; }
     
@@ -95,141 +144,154 @@ public:
         query[offset + 2] = 0;
         query[offset + 3] = val;
     }
-
-    void setCrc()
+    
+    // header of a write multiple of the register R, checked against the frame size
+    template <typename R>
+    void setWrite(uint8_t id)
     {
-        uint16_t crc16 = crc.get(query.data(), query.size() - 2);
-        auto it = std::end(query);
-        *(--it) = crc16 >> 8;
-        *(--it) = crc16 & 0xFF;
+        static_assert(writeFrameSize(R::words) == Size, "frame size does not match the register width");
+        setID(id);
+        setFunc(0x10);
+        setAddr(R::address);
+        setRegSize(R::words);
+        setRegBytes(R::words * 2);
     }
     
+    template <typename F>
+    void set(typename F::value_type value) { encode<F>(query, value); }
     
-public:
+    template <typename F>
+    typename F::value_type get() const { return decode<F>(query.data()); }
+    
+    
+protected:
 
-    std::array<uint8_t, Size> query;
-    CrcGenerator crc;
-    const uint8_t val_offset = 7;
+    std::array<uint8_t, Size> query {};
     
 };
 
-class RemoteIOs : public QueryImpl<13>
+template <size_t Size>
+constexpr uint8_t FixedFrame<Size>::val_offset;
+
+// write multiple of the register R, the frame sized by R at compile time
+template <typename R>
+using WriteFrame = FixedFrame<writeFrameSize(R::words)>;
+
+class RemoteIOs : public WriteFrame<reg::RemoteIO>
 {
-    std::unordered_map<CmdType, uint16_t, EnumClassHash> remote_ios_val
-    {
-        {CmdType::Start,  0x0008},
-        {CmdType::Home,   0x0010},
-        {CmdType::Stop,   0x0020},
-        {CmdType::Free,   0x0040},
-        {CmdType::Reset,  0x0080},
-        {CmdType::JogFwd, 0x1000},
-        {CmdType::JogBwd, 0x2000},
-        {CmdType::Clear,  0x0000},
-    };
+public:
     
+    using Value = WriteField<0>;
     
-public:
+    static constexpr uint16_t value(CmdType cmd)
+    {
+        return (cmd == CmdType::Start)  ? 0x0008 :
+               (cmd == CmdType::Home)   ? 0x0010 :
+               (cmd == CmdType::Stop)   ? 0x0020 :
+               (cmd == CmdType::Free)   ? 0x0040 :
+               (cmd == CmdType::Reset)  ? 0x0080 :
+               (cmd == CmdType::JogFwd) ? 0x1000 :
+               (cmd == CmdType::JogBwd) ? 0x2000 : 0x0000;
+    }
     
     RemoteIOs(CmdType cmd, uint8_t id = 0)
     {
-        setID(id);
-        setFunc(0x10);
-        setAddr(0x007C);
-        setRegSize(2);
-        setRegBytes(4);
+        setWrite<reg::RemoteIO>(id);
         setCommand(cmd);
     }
     
-    void setCommand(CmdType cmd) { setValue32(val_offset, remote_ios_val[cmd]); }
+    void setCommand(CmdType cmd) { set<Value>(value(cmd)); }
 };
 
 
 
-class NetSelect : public QueryImpl<13>
+class NetSelect : public WriteFrame<reg::NetSelect>
 {
 public:
     
+    using Value = WriteField<0>;
+    
     NetSelect(uint8_t no, uint8_t id = 0)
     {
-        setID(id);
-        setFunc(0x10);
-        setAddr(0x007A);
-        setRegSize(2);
-        setRegBytes(4);
-        setValue8(val_offset, no);
+        setWrite<reg::NetSelect>(id);
+        set<Value>(no);
     }
+};
+
+
+// drive id joins the group addr (-1 : leaves its group)
+class GroupAddress : public WriteFrame<reg::GroupAddress>
+{
+public:
     
+    using Value = WriteField<0, true>;
+    
+    GroupAddress(int32_t addr, uint8_t id = 0)
+    {
+        setWrite<reg::GroupAddress>(id);
+        set<Value>(addr);
+    }
 };
 
 
-class JogSteps : public QueryImpl<13>
+class JogSteps : public WriteFrame<reg::JogSteps>
 {
 public:
     
+    using Value = WriteField<0>;
+    
     JogSteps(uint32_t steps, uint8_t id = 0)
     {
-        setID(id);
-        setFunc(0x10);
-        setAddr(0x02A0);
-        setRegSize(2);
-        setRegBytes(4);
-        setValue32(val_offset, steps);
+        setWrite<reg::JogSteps>(id);
+        set<Value>(steps);
     }
 };
 
 
-class JogSpeed : public QueryImpl<13>
+class JogSpeed : public WriteFrame<reg::JogSpeed>
 {
 public:
     
+    using Value = WriteField<0>;
+    
     JogSpeed(uint32_t speed, uint8_t id = 0)
     {
-        setID(id);
-        setFunc(0x10);
-        setAddr(0x02A2);
-        setRegSize(2);
-        setRegBytes(4);
-        setValue32(val_offset, speed);
+        setWrite<reg::JogSpeed>(id);
+        set<Value>(speed);
     }
 };
 
 
-class Origin : public QueryImpl<13>
+class Origin : public WriteFrame<reg::Origin>
 {
 public:
     
+    using Value = WriteField<0, true>;
+    
     Origin(int32_t pos, uint8_t id = 0)
     {
-        setID(id);
-        setFunc(0x10);
-        setAddr(0x038C);
-        setRegSize(2);
-        setRegBytes(4);
-        setValue32(val_offset, pos);
+        setWrite<reg::Origin>(id);
+        set<Value>(pos);
     }
 };
 
 
-class DirectDrive : public QueryImpl<41>
+class DirectDrive : public WriteFrame<reg::DirectDrive>
 {
-    const uint8_t no_offset = 7;
-    const uint8_t mode_offset = 11;
-    const uint8_t pos_offset = 15;
-    const uint8_t vel_offset = 19;
-    const uint8_t acc_offset = 23;
-    const uint8_t dec_offset = 27;
-    const uint8_t crnt_offset = 31;
-    const uint8_t trig_offset = 35;
-    
 public:
     
+    using No = WriteField<0>;
+    using Mode = WriteField<1>;
+    using Pos = WriteField<2, true>;
+    using Vel = WriteField<3, true>;
+    using Acc = WriteField<4>;
+    using Dec = WriteField<5>;
+    using Crnt = WriteField<6>;
+    using Trig = WriteField<7>;
+    
     DirectDrive(uint8_t id = 0)
     {
-        setID(id);
-        setFunc(0x10);
-        setAddr(0x58);
-        setRegSize(0x10);
-        setRegBytes(0x20);
+        setWrite<reg::DirectDrive>(id);
         setDriveNo(0xFF);
         setDriveMode(0x01);
         setPosition(0);
@@ -240,17 +302,74 @@ public:
         setTrigger(1);
     }
     
-    void setDriveNo(uint8_t no) { setValue8(no_offset, no); }
-    void setDriveMode(uint8_t mode) { setValue8(mode_offset, mode); }
-    void setPosition(uint32_t pos) { setValue32(pos_offset, pos); }
-    void setVelocity(uint32_t vel) { setValue32(vel_offset, vel); }
-    void setAcceleration(uint32_t acc) { setValue32(acc_offset, acc); }
-    void setDeceleration(uint32_t dec) { setValue32(dec_offset, dec); }
-    void setCurrent(uint32_t crnt) { setValue32(crnt_offset, crnt); }
-    void setTrigger(char trig) { setValue8(trig_offset, (uint8_t)trig); }
+    void setDriveNo(uint8_t no) { set<No>(no); }
+    void setDriveMode(uint8_t mode) { set<Mode>(mode); }
+    void setPosition(uint32_t pos) { set<Pos>((int32_t)pos); }
+    void setVelocity(uint32_t vel) { set<Vel>((int32_t)vel); }
+    void setAcceleration(uint32_t acc) { set<Acc>(acc); }
+    void setDeceleration(uint32_t dec) { set<Dec>(dec); }
+    void setCurrent(uint32_t crnt) { set<Crnt>(crnt); }
+    void setTrigger(char trig) { set<Trig>((uint8_t)trig); }
 };
 
 
+// operation data of one drive data number, to be run later by data_no() + start()
+// layout of AZ series : data No.n starts at 0x1800 + n * 0x40
+class OperationData : public WriteFrame<reg::OperationData>
+{
+public:
+    
+    using Mode = WriteField<0>;
+    using Pos = WriteField<1, true>;
+    using Vel = WriteField<2, true>;
+    using Acc = WriteField<3>;
+    using Dec = WriteField<4>;
+    using Crnt = WriteField<5>;
+    
+    static uint16_t address(uint8_t no) { return reg::OperationData::address + no * 0x40; }
+    
+    OperationData(uint8_t no, uint8_t id = 0)
+    {
+        setWrite<reg::OperationData>(id);
+        setAddr(address(no));
+        setDriveMode(0x01);
+        setPosition(0);
+        setVelocity(0);
+        setAcceleration(0);
+        setDeceleration(0);
+        setCurrent(0x03E8);
+    }
+    
+    void setDriveMode(uint8_t mode) { set<Mode>(mode); }
+    void setPosition(uint32_t pos) { set<Pos>((int32_t)pos); }
+    void setVelocity(uint32_t vel) { set<Vel>((int32_t)vel); }
+    void setAcceleration(uint32_t acc) { set<Acc>(acc); }
+    void setDeceleration(uint32_t dec) { set<Dec>(dec); }
+    void setCurrent(uint32_t crnt) { set<Crnt>(crnt); }
+};
+
+
+// write multiple (0x10) of any register range, up to max_write_regs registers
+inline Frame registerWrite(uint8_t id, uint16_t addr, const std::vector<uint16_t>& values)
+{
+    size_t n = std::min(values.size(), max_write_regs);
+    std::array<uint8_t, max_frame_size> bytes;
+    bytes[0] = id;
+    bytes[1] = 0x10;
+    bytes[2] = (addr >> 8) & 0xFF;
+    bytes[3] = (addr >> 0) & 0xFF;
+    bytes[4] = 0x00;
+    bytes[5] = (uint8_t)n;
+    bytes[6] = (uint8_t)(2 * n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        bytes[7 + 2 * i] = (values[i] >> 8) & 0xFF;
+        bytes[8 + 2 * i] = (values[i] >> 0) & 0xFF;
+    }
+    return Frame(bytes.data(), writeFrameSize(n));
+}
+
+
 OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
 
 #endif /* OFXMODBUSORIENTAL_QUERY_H */
@@ -0,0 +1,149 @@
+#ifndef OFXMODBUSORIENTAL_REGISTERMAP_H
+#define OFXMODBUSORIENTAL_REGISTERMAP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <type_traits>
+#include <vector>
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// compile time description of the drive registers and of the frames which carry them.
+// frames encode / decode through these types, so offsets are constants folded into the code
+// and a field which does not fit its frame is a compile error.
+// the frames themselves are plain values (FixedFrame, Frame in Query.h), no virtual call and
+// no allocation per command.
+
+// a register (or register block) : first address, width in 16 bit words, signedness
+template <uint16_t Address, uint8_t Words = 2, bool Signed = false>
+struct Register
+{
+    static constexpr uint16_t address = Address;
+    static constexpr uint8_t words = Words;
+    static constexpr bool is_signed = Signed;
+    static constexpr size_t bytes = 2 * Words;
+    using value_type = typename std::conditional<Signed, int32_t, uint32_t>::type;
+};
+
+// a field of a frame : byte offset and width, big endian on the wire
+template <size_t Offset, size_t Bytes = 4, bool Signed = false>
+struct Field
+{
+    static_assert(Bytes >= 1 && Bytes <= 4, "fields are 8 - 32 bit");
+    static constexpr size_t offset = Offset;
+    static constexpr size_t bytes = Bytes;
+    static constexpr bool is_signed = Signed;
+    using value_type = typename std::conditional<Signed, int32_t, uint32_t>::type;
+};
+
+// write multiple (0x10) : id, func, address, count, byte count, data, crc
+constexpr size_t writeFrameSize(size_t words) { return 9 + 2 * words; }
+
+// 32 bit value k of the data of a write multiple frame
+template <size_t K, bool Signed = false>
+using WriteField = Field<7 + 4 * K, 4, Signed>;
+
+// 32 bit value k of the data of a read (0x03) reply, from the first data byte
+template <size_t K, bool Signed = false>
+using ReadField = Field<4 * K, 4, Signed>;
+
+namespace reg
+{
+    // group address the drive also takes frames to, -1 : none (AZ series)
+    using GroupAddress       = Register<0x0030, 2, true>;
+    using NetSelect          = Register<0x007A>;
+    using RemoteIO           = Register<0x007C>;
+    using Status             = Register<0x007E>;
+    using Position           = Register<0x0120, 2, true>;
+    using JogSteps           = Register<0x02A0>;
+    using JogSpeed           = Register<0x02A2>;
+    using Origin             = Register<0x038C, 2, true>;
+    // no, mode, pos, vel, acc, dec, current, trigger
+    using DirectDrive        = Register<0x0058, 16>;
+    // 59 slots (+ slot 0) of 32 bit
+    using ConcurrentPosition = Register<0x0400, 0x7B, true>;
+    using ConcurrentVelocity = Register<0x0480, 0x7B, true>;
+    using ConcurrentMode     = Register<0x0500, 0x7B>;
+    using ConcurrentAcc      = Register<0x0600, 0x7B>;
+    using ConcurrentDec      = Register<0x0680, 0x7B>;
+    using ConcurrentCurrent  = Register<0x0700, 0x7B>;
+    // mode, pos, vel, acc, dec, current of data No.0, No.n at + n * 0x40 (AZ series)
+    using OperationData      = Register<0x1800, 12>;
+}
+
+template <typename F, size_t N>
+inline void encode(std::array<uint8_t, N>& frame, typename F::value_type value)
+{
+    static_assert(F::offset + F::bytes + 2 <= N, "field overlaps the crc of its frame");
+    uint32_t v = (uint32_t)value;
+    for (size_t i = 0; i < F::bytes; ++i)
+        frame[F::offset + i] = (v >> (8 * (F::bytes - 1 - i))) & 0xFF;
+}
+
+// sign extended when the field is signed
+template <typename F>
+inline typename F::value_type decode(const uint8_t* data)
+{
+    uint32_t v = 0;
+    for (size_t i = 0; i < F::bytes; ++i) v = (v << 8) | data[F::offset + i];
+    if (F::is_signed && F::bytes < 4 && (v >> (8 * F::bytes - 1)) & 1) v |= ~(uint32_t)0 << (8 * F::bytes);
+    return (typename F::value_type)v;
+}
+
+// runtime counterpart of decode<F>() for fields described at run time
+inline int32_t decode(const uint8_t* data, size_t bytes, bool is_signed)
+{
+    uint32_t v = 0;
+    for (size_t i = 0; i < bytes; ++i) v = (v << 8) | data[i];
+    if (is_signed && bytes < 4 && (v >> (8 * bytes - 1)) & 1) v |= ~(uint32_t)0 << (8 * bytes);
+    return (int32_t)v;
+}
+
+// what a read reply carries, decoded straight into the controller state
+enum class Channel : uint8_t { Status, Alarm, Position, Velocity, Load };
+static constexpr size_t num_channels = 5;
+
+// value of a channel, starting word registers after the first address of a read range,
+// bytes wide (1 - 4, big endian) and sign extended when signed. of<F>() takes both from a
+// Register or a Field, e.g. ChannelField::of<reg::Position>(Channel::Position, 4)
+struct ChannelField
+{
+    ChannelField(Channel channel, uint8_t word, uint8_t bytes = 4, bool is_signed = false)
+    : channel(channel), word(word), bytes(bytes), is_signed(is_signed) {}
+    
+    template <typename F>
+    static ChannelField of(Channel channel, uint8_t word)
+    {
+        static_assert(F::bytes >= 1 && F::bytes <= 4, "channels are 8 - 32 bit");
+        return ChannelField(channel, word, (uint8_t)F::bytes, F::is_signed);
+    }
+    
+    int32_t decode(const uint8_t* range) const { return ofxModbusOriental::decode(range + 2 * (size_t)word, bytes, is_signed); }
+    
+    Channel channel;
+    uint8_t word;
+    uint8_t bytes;
+    bool is_signed;
+};
+
+// register range of a read request and the channels found in it.
+// the reply must carry exactly words registers, or it is rejected
+struct ReadMap
+{
+    uint16_t address;
+    uint8_t words;
+    std::vector<ChannelField> fields;
+
+    bool valid() const
+    {
+        if (words == 0 || words > 125) return false;
+        for (auto& f : fields)
+            if (f.bytes < 1 || f.bytes > 4 || 2 * (size_t)f.word + f.bytes > 2 * (size_t)words) return false;
+        return true;
+    }
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_REGISTERMAP_H */
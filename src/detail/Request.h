@@ -2,47 +2,157 @@
 #define OFXMODBUSORIENTAL_REQUEST_H
 
 #include <cstdint>
-#include <unordered_map>
+#include <array>
+#include <memory>
+#include <vector>
+#include "Query.h"
+#include "Handle.h"
 
 OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
 
-enum class RequestType { Status, Position };
+// Block : any register range, see Stream::readRegisters()
+// Monitor : the ReadMap given to ControllerCore::setMonitorMap()
+enum class RequestType { Status, Position, Block, Monitor };
 
-class Request : public QueryImpl<8>
+class Request : public FixedFrame<8>
 {
+public:
+	
+	// channels of a reply, decoded through the ReadMap of its request
+	struct Decoded
+	{
+		uint8_t mask {0};
+		std::array<int32_t, num_channels> values {};
+		
+		bool has(Channel c) const { return (mask >> (size_t)c) & 1; }
+		int32_t get(Channel c) const { return values[(size_t)c]; }
+		void set(Channel c, int32_t v) { values[(size_t)c] = v; mask |= 1 << (size_t)c; }
+	};
+	
+private:
+	
 	RequestType key;
 	uint32_t response {0};
 	bool b_requested {false};
 	bool b_received {false};
 	size_t tick_count {0};
+	Nanos requested_time {0};
+	uint64_t trace_id {0};
 	size_t tick_timeout {3};
-	
-    unordered_map<RequestType, uint16_t, EnumClassHash> request_reg_map
-    {
-        {RequestType::Status, 0x007E},
-        {RequestType::Position, 0x0120}
-    };
+	uint8_t exception_code {0};
+	bool b_exception {false};
+	std::shared_ptr<Completion> completion;
+	std::shared_ptr<std::vector<uint16_t>> registers;
+	std::shared_ptr<const ReadMap> map;
+	Decoded decoded;
 	
 public:
     
-    Request(uint8_t id, RequestType req)
+    // register range and channels of the fixed request types
+    static const std::shared_ptr<const ReadMap>& readMap(RequestType req)
+    {
+        static const std::shared_ptr<const ReadMap> status = std::make_shared<const ReadMap>(ReadMap {
+            reg::Status::address, reg::Status::words, { ChannelField::of<reg::Status>(Channel::Status, 0) } });
+        static const std::shared_ptr<const ReadMap> position = std::make_shared<const ReadMap>(ReadMap {
+            reg::Position::address, reg::Position::words, { ChannelField::of<reg::Position>(Channel::Position, 0) } });
+        static const std::shared_ptr<const ReadMap> none;
+        switch (req)
+        {
+            case RequestType::Status: return status;
+            case RequestType::Position: return position;
+            default: return none;
+        }
+    }
+    
+    Request(uint8_t id, RequestType req) : Request(id, readMap(req))
+    {
+		key = req;
+    }
+    
+    Request(uint8_t id, std::shared_ptr<const ReadMap> m)
     {
         setID(id);
         setFunc(0x03);
-        setAddr(request_reg_map[req]);
-        setRegSize(2);
-		key = req;
+        setAddr(m->address);
+        setRegSize(m->words);
+        key = RequestType::Monitor;
+        map = m;
+    }
+    
+    // block read of count registers into out, filled before the completion resolves
+    Request(uint8_t id, uint16_t addr, uint16_t count, std::shared_ptr<std::vector<uint16_t>> out)
+    {
+        setID(id);
+        setFunc(0x03);
+        setAddr(addr);
+        setRegSize((uint8_t)count);
+        key = RequestType::Block;
+        registers = out;
+        // 3 ticks for a 9 byte reply, longer replies get proportionally more
+        tick_timeout = 3 * ((5 + 2 * (size_t)count + 8) / 9);
+    }
+    
+    // reverse lookup of the register address in a captured read request
+    static bool find(uint16_t addr, RequestType& req)
+    {
+        for (RequestType r : { RequestType::Status, RequestType::Position })
+        {
+            if (readMap(r)->address != addr) continue;
+            req = r;
+            return true;
+        }
+        return false;
+    }
+	
+    // 0 for the types without a fixed register range, check readMap() first
+    static uint16_t address(RequestType req)
+    {
+        const std::shared_ptr<const ReadMap>& m = readMap(req);
+        return m ? m->address : 0;
     }
 	
 	bool isRequested() { return b_requested; }
 	bool isReceived() { return b_received; }
 	
-	uint8_t getID() { return query[0]; }
 	RequestType getKey() { return key; }
+	uint16_t getAddr() { return (query[2] << 8) | query[3]; }
+	uint16_t getRegCount() { return query[5]; }
+	const ReadMap* getMap() { return map.get(); }
+	const Decoded& getDecoded() { return decoded; }
 	uint32_t getResponse() { return response; }
 	
     void setResponse(uint32_t r) { response = r; b_received = true; }
-	void requested() { b_requested = true; }
+    void setRegisters(const std::vector<uint8_t>& bytes)
+    {
+        if (registers)
+        {
+            registers->resize(bytes.size() / 2);
+            for (size_t i = 0; i < registers->size(); ++i) (*registers)[i] = (bytes[2 * i] << 8) | bytes[2 * i + 1];
+        }
+        b_received = true;
+    }
+    // reply data of a mapped request : its size was checked against the map.
+    // the value of the Handle is the first field
+    void setDecoded(const uint8_t* data)
+    {
+        for (auto& f : map->fields) decoded.set(f.channel, f.decode(data));
+        response = map->fields.empty() ? 0 : (uint32_t)decoded.get(map->fields.front().channel);
+        b_received = true;
+    }
+    void setException(uint8_t code) { exception_code = code; b_exception = true; b_received = true; }
+	bool isException() { return b_exception; }
+	uint8_t getException() { return exception_code; }
+	
+	void setCompletion(std::shared_ptr<Completion> c) { completion = c; }
+	void resolve(Result::Status status, uint32_t value = 0)
+	{
+		if (completion) completion->resolve(status, value, exception_code);
+	}
+	void requested(Nanos t = 0) { b_requested = true; requested_time = t; }
+	Nanos getRequestedTime() { return requested_time; }
+	
+	void setTraceID(uint64_t t) { trace_id = t; }
+	uint64_t getTraceID() { return trace_id; }
 	
 	bool timeout() { return (++tick_count >= tick_timeout) ? true : false; }
 	void setTimeout(size_t count) { tick_timeout = count; }
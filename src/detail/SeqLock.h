@@ -0,0 +1,69 @@
+#ifndef OFXMODBUSORIENTAL_SEQLOCK_H
+#define OFXMODBUSORIENTAL_SEQLOCK_H
+
+#include <atomic>
+#include <array>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// one writer publishes a value, any number of readers copy it without locks.
+// the writer never waits, a reader retries while a store overlaps its copy.
+// the value is kept in atomic words so that an overlapping copy is a retry, not a data race
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable value");
+    static constexpr size_t num_words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+
+    SeqLock() { store(T()); }
+
+    // writer thread only
+    void store(const T& value)
+    {
+        std::array<uint64_t, num_words> words {};
+        std::memcpy(words.data(), &value, sizeof(T));
+        uint64_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < num_words; ++i) data[i].store(words[i], std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    // any thread
+    T load() const
+    {
+        T value;
+        while (!tryLoad(value)) std::this_thread::yield();
+        return value;
+    }
+
+    // false when a store overlapped the copy
+    bool tryLoad(T& value) const
+    {
+        std::array<uint64_t, num_words> words;
+        uint64_t s0 = seq.load(std::memory_order_acquire);
+        if (s0 & 1) return false;
+        for (size_t i = 0; i < num_words; ++i) words[i] = data[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) != s0) return false;
+        std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+        return true;
+    }
+
+    // number of completed stores
+    uint64_t version() const { return seq.load(std::memory_order_acquire) / 2; }
+
+private:
+
+    std::atomic<uint64_t> seq {0};
+    std::array<std::atomic<uint64_t>, num_words> data;
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_SEQLOCK_H */
@@ -0,0 +1,112 @@
+#ifndef OFXMODBUSORIENTAL_SERIALPORT_H
+#define OFXMODBUSORIENTAL_SERIALPORT_H
+
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "Transport.h"
+#include "Log.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// posix serial port transport, no openFrameworks needed
+// default frame format is the one of oriental drives : 8 data bits, even parity, 2 stop bits
+class SerialPort : public Transport
+{
+public:
+
+    enum class Parity { None, Even, Odd };
+
+    SerialPort() {}
+    SerialPort(const std::string& path, size_t baud, Parity parity = Parity::Even, size_t stop_bits = 2)
+    {
+        open(path, baud, parity, stop_bits);
+    }
+    virtual ~SerialPort() { close(); }
+
+    bool open(const std::string& path, size_t baud, Parity parity = Parity::Even, size_t stop_bits = 2)
+    {
+        close();
+        fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (fd < 0)
+        {
+            logError("ofxModbusOriental") << "could not open serial port " << path;
+            return false;
+        }
+
+        termios tio;
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cflag &= ~(PARENB | PARODD | CSTOPB);
+        if (parity != Parity::None) tio.c_cflag |= PARENB;
+        if (parity == Parity::Odd) tio.c_cflag |= PARODD;
+        if (stop_bits == 2) tio.c_cflag |= CSTOPB;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+
+        speed_t speed;
+        if (!toSpeed(baud, speed))
+        {
+            logError("ofxModbusOriental") << "unsupported baud rate " << baud;
+            close();
+            return false;
+        }
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+
+        if (tcsetattr(fd, TCSANOW, &tio) != 0)
+        {
+            logError("ofxModbusOriental") << "could not configure serial port " << path;
+            close();
+            return false;
+        }
+        tcflush(fd, TCIOFLUSH);
+        return true;
+    }
+
+    virtual bool isOpen() override { return fd >= 0; }
+
+    virtual size_t available() override
+    {
+        int n = 0;
+        if (fd < 0 || ioctl(fd, FIONREAD, &n) != 0) return 0;
+        return (size_t)n;
+    }
+
+    virtual long read(uint8_t* data, size_t size) override { return (fd < 0) ? -1 : ::read(fd, data, size); }
+
+    virtual long write(const uint8_t* data, size_t size) override { return (fd < 0) ? -1 : ::write(fd, data, size); }
+
+    virtual void close() override
+    {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    virtual int getFd() override { return fd; }
+
+private:
+
+    static bool toSpeed(size_t baud, speed_t& speed)
+    {
+        switch (baud)
+        {
+            case 9600:   speed = B9600;   return true;
+            case 19200:  speed = B19200;  return true;
+            case 38400:  speed = B38400;  return true;
+            case 57600:  speed = B57600;  return true;
+            case 115200: speed = B115200; return true;
+            case 230400: speed = B230400; return true;
+            default: return false;
+        }
+    }
+
+    int fd {-1};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_SERIALPORT_H */
@@ -0,0 +1,149 @@
+#ifndef OFXMODBUSORIENTAL_SHADOW_H
+#define OFXMODBUSORIENTAL_SHADOW_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include "Utils.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// mirror of what each drive has confirmed, per 32 bit register (pair of modbus registers
+// at an even address, the layout of the drive parameters)
+// a value is confirmed by the echo of a unicast write or by a read reply.
+// a broadcast write can't be confirmed, so it invalidates its registers on every drive.
+// called from the update() thread and from the app, guarded by a mutex
+class ShadowRegisters
+{
+public:
+
+    struct Entry
+    {
+        Entry() {}
+        Entry(uint32_t value, Nanos time) : value(value), time(time) {}
+        uint32_t value {0};
+        Nanos time {0}; // steady_clock [ns] of the confirmation
+    };
+
+    void confirm(uint8_t id, uint16_t addr, uint32_t value, Nanos time)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        regs[key(id, addr)] = Entry(value, time);
+    }
+
+    // every 32 bit value of an echoed write multiple (0x10) frame
+    void confirmWrite(const uint8_t* frame, size_t size, Nanos time)
+    {
+        uint16_t addr;
+        size_t words;
+        if (!parseWrite(frame, size, addr, words)) return;
+        confirmRegisters(frame[0], addr, frame + 7, words, time);
+    }
+
+    // registers of a read reply or of a write, big endian. only whole even aligned pairs are
+    // confirmed, a half pair at either end is forgotten (a write may have changed it)
+    void confirmRegisters(uint8_t id, uint16_t addr, const uint8_t* data, size_t words, Nanos time)
+    {
+        if (words == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t first = addr & 1;
+        for (size_t k = first; k + 1 < words; k += 2)
+            regs[key(id, addr + k)] = Entry(value(data, k), time);
+        if (first) regs.erase(key(id, addr - 1));
+        if ((words - first) & 1) regs.erase(key(id, addr + words - 1));
+    }
+
+    // b_shared : the frame went to broadcast or a group address, so it touched unknown drives
+    void invalidateWrite(const uint8_t* frame, size_t size, Nanos time, bool b_shared = false)
+    {
+        uint16_t addr;
+        size_t words;
+        if (!parseWrite(frame, size, addr, words) || words == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        // every pair it touched
+        for (uint32_t r = addr & ~1u; r < (uint32_t)addr + words; r += 2)
+        {
+            if (b_shared || frame[0] == 0) broadcast[(uint16_t)r] = time;
+            else regs.erase(key(frame[0], (uint16_t)r));
+        }
+    }
+
+    // forget a drive (power cycle, replaced, ...), 0 forgets every drive
+    void invalidate(uint8_t id = 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (id == 0)
+        {
+            regs.clear();
+            broadcast.clear();
+            return;
+        }
+        for (auto it = regs.begin(); it != regs.end();)
+        {
+            if ((it->first >> 16) == id) it = regs.erase(it);
+            else ++it;
+        }
+    }
+
+    // true when the drive has already confirmed every value of this unicast write
+    bool matches(const uint8_t* frame, size_t size)
+    {
+        uint16_t addr;
+        size_t words;
+        if (!parseWrite(frame, size, addr, words) || frame[0] == 0 || (addr & 1) || (words & 1)) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t k = 0; k < words; k += 2)
+        {
+            Entry e;
+            if (!findLocked(frame[0], addr + k, e) || e.value != value(frame + 7, k)) return false;
+        }
+        return true;
+    }
+
+    // max_age < 0 accepts any age
+    bool get(uint8_t id, uint16_t addr, Entry& e, Nanos max_age = -1)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!findLocked(id, addr, e)) return false;
+        return max_age < 0 || nowNanos() - e.time <= max_age;
+    }
+
+private:
+
+    static uint32_t key(uint8_t id, uint16_t addr) { return ((uint32_t)id << 16) | addr; }
+
+    // 32 bit value from register k of data
+    static uint32_t value(const uint8_t* data, size_t k)
+    {
+        const uint8_t* p = data + 2 * k;
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+    }
+
+    // id, 0x10, addr (2), registers (2), bytes (1), values, crc (2)
+    static bool parseWrite(const uint8_t* frame, size_t size, uint16_t& addr, size_t& words)
+    {
+        if (size < 9 || frame[1] != 0x10) return false;
+        addr = (frame[2] << 8) | frame[3];
+        words = frame[6] / 2;
+        return 7 + (size_t)frame[6] + 2 <= size;
+    }
+
+    bool findLocked(uint8_t id, uint16_t addr, Entry& e)
+    {
+        auto it = regs.find(key(id, addr));
+        if (it == regs.end()) return false;
+        auto b = broadcast.find(addr);
+        if (b != broadcast.end() && b->second >= it->second.time) return false;
+        e = it->second;
+        return true;
+    }
+
+    std::mutex mutex;
+    std::unordered_map<uint32_t, Entry> regs;
+    std::unordered_map<uint16_t, Nanos> broadcast; // last broadcast write per register
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_SHADOW_H */
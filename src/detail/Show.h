@@ -0,0 +1,408 @@
+#ifndef OFXMODBUSORIENTAL_SHOW_H
+#define OFXMODBUSORIENTAL_SHOW_H
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Log.h"
+#include "MappedFile.h"
+#include "Buffer.h"
+#include "FrameCache.h"
+#include "Motion.h"
+#include "Transport.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// precompiled show : every frame of a timeline with its send time
+//
+// header  : 32 bytes, "OMSHW" + version at 0, frame count [uint32] at 8, interval [ns, uint64] at 12,
+//           duration [ns, uint64] at 20, crc16 of the records [uint16] at 28
+// records : time [ns, uint64] + size [uint16] + bytes (modbus crc included)
+// integers are stored in host byte order, time is from the start of the show
+
+static const char show_magic[5] = { 'O', 'M', 'S', 'H', 'W' };
+static const uint8_t show_version = 1;
+static const size_t show_header_size = 32;
+static const size_t show_record_header_size = 10;
+
+// turns multi-axis keyframes into the frames live playback would send
+// (setMotionTriangle() + write(0) + start(0) + clear(0)), laid out on the bus interval.
+// every distinct keyframe time is a cue : the concurrent frames which changed since the previous
+// cue go out on the slots before it, the start frame on the cue itself and the clear one slot after.
+// a cue whose frames do not fit behind the previous one is shifted later, see getMaxLateness().
+// only broadcast and group frames are written, so playback never waits for a reply
+template <size_t Size>
+class ShowCompiler
+{
+public:
+
+    explicit ShowCompiler(double interval) : interval(std::max<Nanos>(toNanos(interval), 1))
+    {
+        modes.fill(0x01);
+        currents.fill(0x03E8);
+        addrs.fill(0);
+    }
+
+    // drive group address of each group of 59 motors, as Controller::setGroupAddress().
+    // with more than one group every group needs its own, Size < addr <= 247
+    bool setGroupAddress(size_t g, uint8_t addr)
+    {
+        if (g >= addrs.size() || addr <= Size || addr > FrameCache::max_id) return false;
+        addrs[g] = addr;
+        return true;
+    }
+    void setMode(uint8_t id, uint8_t mode) { if (valid(id)) modes[id] = mode; }
+    void setCurrent(uint8_t id, uint16_t crnt) { if (valid(id)) currents[id] = crnt; }
+
+    // motor id is at pos at time [s]. the first keyframe of a motor is where it starts
+    void key(double time, uint8_t id, int32_t pos)
+    {
+        if (!valid(id) || time < 0.0) return;
+        keys[id][toNanos(time)] = pos;
+    }
+
+    void clear()
+    {
+        for (auto& k : keys) k.clear();
+    }
+
+    bool compile(const std::string& path)
+    {
+        if (!BufferGroups<Size>::distinct(addrs))
+        {
+            logError("ofxModbusOriental") << "show : groups share an address, their slots would overwrite each other, see setGroupAddress()";
+            return false;
+        }
+        // cue time -> motors starting a segment there
+        std::map<Nanos, std::vector<uint8_t>> cues;
+        BufferGroups<Size> buffer;
+        for (size_t g = 0; g < buffer.size(); ++g) buffer.setAddress(g, addrs[g]);
+        for (size_t i = 1; i <= Size; ++i)
+        {
+            buffer.setMode(i, modes[i]);
+            buffer.setCurrent(i, currents[i]);
+            if (keys[i].empty()) continue;
+            buffer.setPosition(i, keys[i].begin()->second);
+            for (auto it = keys[i].begin(); std::next(it) != keys[i].end(); ++it) cues[it->first].push_back((uint8_t)i);
+        }
+
+        std::vector<Record> frames;
+        std::array<std::vector<uint8_t>, 6 * BufferGroups<Size>::num_groups> sent;
+        Nanos cursor = -interval;
+        max_lateness = 0;
+        for (auto& cue : cues)
+        {
+            for (uint8_t id : cue.second)
+            {
+                auto it = keys[id].find(cue.first);
+                auto next = std::next(it);
+                Profile p = triangleProfile(it->second, next->second, (float)toSec(next->first - it->first), vel_max, acc_max);
+                buffer.setPosition(id, p.pos);
+                buffer.setVelocity(id, p.vel);
+                buffer.setAcceleration(id, p.acc);
+                buffer.setDeceleration(id, p.dec);
+            }
+
+            // the frames which differ from what the drives already hold
+            std::vector<std::vector<uint8_t>> pre;
+            for (size_t g = 0; g < buffer.size(); ++g)
+            {
+                Buffer& b = buffer.group(g);
+                Buffer::FrameOf refs[6] { &Buffer::getModeFrame, &Buffer::getCurrentFrame, &Buffer::getPositionFrame,
+                    &Buffer::getVelocityFrame, &Buffer::getAccelerationFrame, &Buffer::getDecelerationFrame };
+                for (size_t k = 0; k < 6; ++k)
+                {
+                    std::vector<uint8_t> bytes = bytesOf((b.*refs[k])(buffer.getAddress(g)));
+                    if (bytes == sent[6 * g + k]) continue;
+                    sent[6 * g + k] = bytes;
+                    pre.push_back(bytes);
+                }
+            }
+
+            Nanos start = std::max(cue.first, cursor + interval * (Nanos)(pre.size() + 1));
+            max_lateness = std::max(max_lateness, start - cue.first);
+            for (size_t k = 0; k < pre.size(); ++k)
+                frames.push_back({ start - interval * (Nanos)(pre.size() - k), pre[k] });
+            frames.push_back({ start, bytesOf(FrameCache::remoteIOs(CmdType::Start, 0)) });
+            frames.push_back({ start + interval, bytesOf(FrameCache::remoteIOs(CmdType::Clear, 0)) });
+            cursor = start + interval;
+        }
+        num_frames = frames.size();
+        duration = frames.empty() ? 0 : frames.back().time;
+        return write(path, frames);
+    }
+
+    size_t getNumFrames() const { return num_frames; }
+    // last frame of the show
+    Nanos getDuration() const { return duration; }
+    // worst delay of a cue behind its keyframe time, because the frames before it did not fit
+    Nanos getMaxLateness() const { return max_lateness; }
+
+private:
+
+    struct Record
+    {
+        Nanos time;
+        std::vector<uint8_t> bytes;
+    };
+
+    static bool valid(uint8_t id) { return id >= 1 && id <= Size; }
+
+    static std::vector<uint8_t> bytesOf(const Frame& f) { return std::vector<uint8_t>(f.data(), f.data() + f.size()); }
+
+    bool write(const std::string& path, const std::vector<Record>& frames)
+    {
+        std::vector<uint8_t> records;
+        for (auto& f : frames)
+        {
+            uint64_t t = (uint64_t)f.time;
+            uint16_t s = (uint16_t)f.bytes.size();
+            uint8_t header[show_record_header_size];
+            memcpy(header + 0, &t, sizeof(t));
+            memcpy(header + 8, &s, sizeof(s));
+            records.insert(records.end(), header, header + sizeof(header));
+            records.insert(records.end(), f.bytes.begin(), f.bytes.end());
+        }
+
+        uint8_t header[show_header_size] {};
+        uint32_t n = (uint32_t)frames.size();
+        uint64_t i = (uint64_t)interval;
+        uint64_t d = (uint64_t)duration;
+        uint16_t c = crc16(records.data(), records.size());
+        memcpy(header + 0, show_magic, sizeof(show_magic));
+        header[5] = show_version;
+        memcpy(header + 8, &n, sizeof(n));
+        memcpy(header + 12, &i, sizeof(i));
+        memcpy(header + 20, &d, sizeof(d));
+        memcpy(header + 28, &c, sizeof(c));
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+        file.write((const char*)header, sizeof(header));
+        file.write((const char*)records.data(), records.size());
+        return (bool)file;
+    }
+
+    Nanos interval;
+    int32_t vel_max {4000000};     // same limits as ControllerCore
+    uint32_t acc_max {1000000000};
+    std::array<uint8_t, Size + 1> modes;
+    std::array<uint16_t, Size + 1> currents;
+    std::array<uint8_t, BufferGroups<Size>::num_groups> addrs;
+    std::array<std::map<Nanos, int32_t>, Size + 1> keys;
+    size_t num_frames {0};
+    Nanos duration {0};
+    Nanos max_lateness {0};
+};
+
+
+// memory-mapped reader for the files written by ShowCompiler.
+// open() checks the crc of the records and of every frame, so playback computes nothing
+class ShowReader
+{
+public:
+
+    struct Record
+    {
+        uint64_t time_ns;
+        const uint8_t* data;
+        uint16_t size;
+    };
+
+    ~ShowReader() { close(); }
+
+    bool open(const std::string& path)
+    {
+        close();
+        if (!file.open(path) || file.size() < show_header_size) { close(); return false; }
+        head = file.data();
+        length = file.size();
+
+        uint16_t c;
+        memcpy(&num_frames, head + 8, sizeof(num_frames));
+        memcpy(&interval, head + 12, sizeof(interval));
+        memcpy(&duration, head + 20, sizeof(duration));
+        memcpy(&c, head + 28, sizeof(c));
+        if (memcmp(head, show_magic, sizeof(show_magic)) != 0 || head[5] != show_version)
+        {
+            logError("ofxModbusOriental") << "not a show file or unknown version " << path;
+            close();
+            return false;
+        }
+        if (crc16(head + show_header_size, length - show_header_size) != c || !verify())
+        {
+            logError("ofxModbusOriental") << "corrupt show file " << path;
+            close();
+            return false;
+        }
+        rewind();
+        file.sequential();
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        head = nullptr;
+        length = cursor = 0;
+        num_frames = 0;
+    }
+
+    bool isOpen() const { return head != nullptr; }
+
+    void rewind() { cursor = show_header_size; }
+
+    bool next(Record& r)
+    {
+        if (cursor + show_record_header_size > length) return false;
+
+        const uint8_t* p = head + cursor;
+        memcpy(&r.time_ns, p + 0, sizeof(r.time_ns));
+        memcpy(&r.size, p + 8, sizeof(r.size));
+        if (cursor + show_record_header_size + r.size > length) return false;
+
+        r.data = p + show_record_header_size;
+        cursor += show_record_header_size + r.size;
+        return true;
+    }
+
+    size_t getNumFrames() const { return num_frames; }
+    Nanos getInterval() const { return (Nanos)interval; }
+    Nanos getDuration() const { return (Nanos)duration; }
+
+private:
+
+    // every record complete, in time order, with a valid modbus crc
+    bool verify()
+    {
+        rewind();
+        Record r;
+        size_t n = 0;
+        uint64_t prev = 0;
+        while (next(r))
+        {
+            if (r.size < 4 || r.time_ns < prev || crc16(r.data, r.size) != 0) return false;
+            prev = r.time_ns;
+            ++n;
+        }
+        return n == num_frames && cursor == length;
+    }
+
+    MappedFile file;
+    const uint8_t* head {nullptr};
+    size_t length {0};
+    size_t cursor {0};
+    uint32_t num_frames {0};
+    uint64_t interval {0};
+    uint64_t duration {0};
+};
+
+
+// plays a show file onto a transport from its own thread : sleeps until each frame is due and
+// writes it as it is. nothing is built, checked or answered during playback.
+// the player owns the bus while it plays, do not run a ControllerCore on the same transport
+class ShowPlayer
+{
+public:
+
+    ~ShowPlayer() { stop(); }
+
+    bool open(const std::string& path)
+    {
+        stop();
+        return reader.open(path);
+    }
+
+    // starts at steady_clock time at, 0 : now
+    bool play(std::shared_ptr<Transport> t, Nanos at = 0)
+    {
+        stop();
+        if (!reader.isOpen() || !t || !t->isOpen()) return false;
+        transport = t;
+        reader.rewind();
+        num_written = 0;
+        num_write_errors = 0;
+        lateness_max = 0;
+        lateness_sum = 0;
+        b_playing = true;
+        th = std::thread(&ShowPlayer::run, this, at ? at : nowNanos());
+        return true;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            b_playing = false;
+        }
+        cv.notify_all();
+        if (th.joinable()) th.join();
+    }
+
+    bool isPlaying() const { return b_playing; }
+    size_t getNumWritten() const { return num_written; }
+    // frames the transport did not take whole, a truncated frame may be on the bus.
+    // neither written nor counted in the lateness
+    size_t getNumWriteErrors() const { return num_write_errors; }
+    size_t getNumFrames() const { return reader.getNumFrames(); }
+    Nanos getDuration() const { return reader.getDuration(); }
+
+    // write time - due time of the frames written so far
+    Nanos getMaxLateness() const { return lateness_max; }
+    Nanos getMeanLateness() const { size_t n = num_written; return n ? lateness_sum / (Nanos)n : 0; }
+
+private:
+
+    void run(Nanos origin)
+    {
+        ShowReader::Record r;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (b_playing && reader.next(r))
+        {
+            Nanos due = origin + (Nanos)r.time_ns;
+            std::chrono::steady_clock::time_point tp { std::chrono::nanoseconds(due) };
+            if (cv.wait_until(lock, tp, [this] { return !b_playing; })) break;
+            lock.unlock();
+            long n = transport->writeAll(r.data, r.size, write_timeout);
+            if (n != (long)r.size)
+            {
+                logError("ofxModbusOriental") << "show : " << n << " of " << r.size << " bytes written at " << toSec((Nanos)r.time_ns) << " sec";
+                ++num_write_errors;
+                lock.lock();
+                continue;
+            }
+            Nanos late = nowNanos() - due;
+            lateness_max = std::max<Nanos>(lateness_max, late);
+            lateness_sum += late;
+            ++num_written;
+            lock.lock();
+        }
+        b_playing = false;
+    }
+
+    ShowReader reader;
+    std::shared_ptr<Transport> transport;
+    std::thread th;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<bool> b_playing {false};
+    std::atomic<size_t> num_written {0};
+    std::atomic<size_t> num_write_errors {0};
+    std::atomic<Nanos> lateness_max {0};
+    std::atomic<Nanos> lateness_sum {0};
+    static constexpr Nanos write_timeout = 20000000; // for room in a full port, as Stream
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_SHOW_H */
@@ -1,135 +1,727 @@
 #ifndef OFXMODBUSORIENTAL_STREAM_H
 #define OFXMODBUSORIENTAL_STREAM_H
 
+#include <array>
 #include <memory>
 #include <deque>
-#include "ofxSerial.h"
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
 #include "Utils.h"
+#include "Log.h"
+#include "Transport.h"
 #include "Query.h"
 #include "Request.h"
+#include "Shadow.h"
 #include "Parser.h"
+#include "Capture.h"
+#include "MpscQueue.h"
+#include "Handle.h"
+#include "Trace.h"
 
 OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
 
-class Stream : public ofxSerial
+class Stream
 {
 public:
 	
-	bool begin(
-        size_t id,
-        size_t baud,
-        data_bits d = OFXSERIAL_DATABIT_8,
-        parity p = OFXSERIAL_PARITY_EVEN,
-        stop_bits s = OFXSERIAL_STOPBIT_2
-	){
-		ofxSerial::setup(id, baud);
-		ofxSerial::setDataBits(d);
-		ofxSerial::setParity(p);
-		ofxSerial::setStopBits(s);
-        ticker.reset();
-	}
-	
-	bool begin(
-        string name,
-        size_t baud,
-        data_bits d = OFXSERIAL_DATABIT_8,
-        parity p = OFXSERIAL_PARITY_EVEN,
-        stop_bits s = OFXSERIAL_STOPBIT_2
-	){
-		ofxSerial::setup(name.c_str(), baud);
-		ofxSerial::setDataBits(d);
-		ofxSerial::setParity(p);
-		ofxSerial::setStopBits(s);
+	bool begin(std::shared_ptr<Transport> t)
+	{
+        transport = t;
         ticker.reset();
+        return isOpen();
 	}
 	
 	void update()
 	{
-		if (!ofxSerial::isInitialized()) return;
+		drain();
+		if (!isOpen()) return;
 		
+        if (b_replay)
+        {
+            while (parser.available()) handleInput(parser.front());
+            return;
+        }
+		
+        // due timed frames go out between ticks, once no reply is on its way
+        if (timed.size() && estops.empty() && timed.front().at <= nowNanos() && quiet()) writeTimed();
+        
         if (ticker.tick())
         {
-            if (requests.size())
+            ageEchoes();
+            if (estops.size()) writeStop();
+            else if (requests.size())
             {
-                auto req = requests.front();
-                if (!req->isRequested())
+                Request& req = requests.front();
+                if (!req.isRequested())
                 {
-                    write(req->data(), req->size());
-                    req->requested();
+                    Frame f = req.frame();
+                    if (write(f.data(), f.size()))
+                    {
+                        req.requested(nowNanos());
+                        trace(req.getTraceID(), req.getID(), TracePoint::Write, req.getRequestedTime());
+                    }
+                    else
+                    {
+                        req.resolve(Result::Status::WriteError);
+                        requests.pop_front();
+                    }
                 }
-				else if (req->timeout())
+				else if (req.timeout())
                 {
-                    ofLogError("Response Timeout!!") << req->getID();
+                    logError("ofxModbusOriental") << "Response Timeout!! " << (int)req.getID();
+                    req.resolve(Result::Status::Timeout);
                     requests.pop_front();
+                    ++num_timeouts;
                 }
             }
             else if (queries.size())
             {
-                write(queries.front()->data(), queries.front()->size());
-                queries.pop_front();
+                Outgoing& out = queries.front();
+                if (out.frame.empty())
+                {
+                    // fence : everything before it has been written, done once the last echo is in
+                    if (echoes.empty())
+                    {
+                        resolve(out.completion, Result::Status::Done);
+                        queries.pop_front();
+                    }
+                }
+                else
+                {
+                    writeQuery(out);
+                    queries.pop_front();
+                }
             }
         }
 		
-		while (ofxSerial::available()) parser.feed(ofxSerial::readByte());
+		uint8_t rx[256];
+		while (size_t n = transport->available())
+		{
+			long r = transport->read(rx, std::min(n, sizeof(rx)));
+			if (r <= 0) break;
+			capture.record(Direction::Rx, rx, r);
+			parser.feed(rx, r, tracing() ? nowNanos() : 0);
+		}
 		while (parser.available()) handleInput(parser.front());
 	}
 
-	void request(RequestType r, uint8_t id)
+	// request() / push_back() / push_front() are thread-safe and never wait for update() :
+	// they go through a lock-free queue to the update() thread and are scheduled there.
+	// the returned Handle resolves with the reply, an exception code or a timeout
+	Handle request(RequestType r, uint8_t id)
 	{
-		parser.clear();
-		if (ofxSerial::isInitialized())
-		{
-			std::shared_ptr<Request> req = std::make_shared<Request>(id, r);
-			requests.push_back(req);
-		}
+		if (!Request::readMap(r)) return Handle::resolved(Result::Status::Invalid); // Block and Monitor need their range
+		return submit(Submission::Kind::Request, Frame(), nullptr, r, id);
+	}
+	
+	// read of a register range whose reply is decoded through map (see ReadMap)
+	Handle request(std::shared_ptr<const ReadMap> map, uint8_t id)
+	{
+		Submission s;
+		s.map = map;
+		return submit(std::move(s), Submission::Kind::Request, Frame(), nullptr, RequestType::Monitor, id);
+	}
+	
+	// block read (0x03) of up to 125 registers, one round trip instead of one per register pair.
+	// out holds the registers once the Handle is ready (its value is the register count)
+	Handle readRegisters(uint8_t id, uint16_t addr, uint16_t count, std::shared_ptr<std::vector<uint16_t>> out)
+	{
+		Submission s;
+		s.addr = addr;
+		s.count = std::min<uint16_t>(count, 125);
+		s.out = out;
+		return submit(std::move(s), Submission::Kind::Request, Frame(), nullptr, RequestType::Block, id);
 	}
 
-	void push_back(std::shared_ptr<Query> q) { if(ofxSerial::isInitialized()) queries.push_back(q); }
+	// f is copied into the queue, on_done is attached before it is handed over,
+	// so it always runs on the update() thread
+	Handle push_back(const Frame& f, Completion::Callback on_done = nullptr) { return submit(Submission::Kind::Back, f, on_done); }
+    
+	Handle push_front(const Frame& f, Completion::Callback on_done = nullptr) { return submit(Submission::Kind::Front, f, on_done); }
+    
+    // f is written at steady_clock time at, off the tick schedule (or as soon after it as no reply
+    // is due), and the next tick is one interval later. on_written gets the time f was handed to
+    // the transport, on the update() thread
+    Handle push_at(const Frame& f, Nanos at, Completion::Callback on_done = nullptr, std::function<void(Nanos)> on_written = nullptr)
+    {
+        Submission s;
+        s.at = at;
+        s.on_written = on_written;
+        return submit(std::move(s), Submission::Kind::At, f, on_done, RequestType::Status, 0);
+    }
     
-	void push_front(std::shared_ptr<Query> q) { if(ofxSerial::isInitialized()) queries.push_front(q); }
+    // resolves when every query submitted before it has been written and echoed,
+    // and no request is waiting. the bus is idle from there until new frames arrive
+    Handle fence() { return submit(Submission::Kind::Back, Frame(), nullptr); }
+    
+    // preempts everything : when update() takes it over, waiting requests (also one whose reply
+    // is still due) and queued queries are cancelled, then f goes out at the next tick and
+    // repeats more times on the following ticks. lock-free queue, any thread
+    Handle emergency(const Frame& f, size_t repeats, Completion::Callback on_done = nullptr)
+    {
+        EStop s;
+        s.frame = f;
+        s.completion = std::make_shared<Completion>(std::move(on_done));
+        s.repeats = repeats;
+        s.called = nowNanos();
+        Handle h(s.completion);
+        num_pending.fetch_add(1, std::memory_order_release);
+        estop_submissions.push(std::move(s));
+        if (waker) waker();
+        return h;
+    }
+    
+    // emergency() call to its first byte handed to the transport
+    struct StopLatency
+    {
+        Nanos last {0};
+        Nanos max {0};
+        size_t count {0};
+    };
+    StopLatency getStopLatency() const
+    {
+        StopLatency l;
+        l.last = stop_latency_last.load(std::memory_order_relaxed);
+        l.max = stop_latency_max.load(std::memory_order_relaxed);
+        l.count = stop_latency_count.load(std::memory_order_acquire);
+        return l;
+    }
+    void resetStopLatency()
+    {
+        stop_latency_last.store(0);
+        stop_latency_max.store(0);
+        stop_latency_count.store(0);
+    }
+    
+    // submitted but not yet taken by update()
+    size_t pending() const { return num_pending.load(std::memory_order_acquire); }
+    
+    // called after each submission, from the submitting thread
+    void setWaker(std::function<void()> w) { waker = w; }
+    
+    // steady_clock time [ns] when update() has something to do next, -1 when idle
+    Nanos deadline()
+    {
+        if (!isOpen() || b_replay) return -1;
+        bool b_timed = timed.size() && quiet();
+        bool b_idle = queries.empty() && requests.empty() && echoes.empty() && estops.empty() && !pending();
+        if (b_idle) return b_timed ? timed.front().at : -1;
+        return b_timed ? std::min(ticker.next(), timed.front().at) : ticker.next();
+    }
     
 	void pop() { queries.pop_front(); }
 	
-	void archiveResponse() { requests.pop_front(); }
+	void archiveResponse()
+	{
+		trace(requests.front().getTraceID(), requests.front().getID(), TracePoint::Handled);
+		requests.pop_front();
+	}
+	
+	void setInterval(double sec) { ticker.setInterval(sec); }
+	double getInterval() { return toSec(ticker.getInterval()); }
 	
-	void setInterval(float sec) { ticker.setInterval(sec); }
+    bool isOpen() { return b_replay || (transport && transport->isOpen()); }
+    
+    std::shared_ptr<Transport> getTransport() { return transport; }
+    
+    // drives never answer frames to a group address, like broadcast (id 0).
+    // call from the update() thread
+    void setGroupAddress(uint8_t addr, bool b_group) { if (addr != 0) replies[addr] = !b_group; }
+    bool isGroupAddress(uint8_t addr) { return addr != 0 && !replies[addr]; }
+    
+    // values confirmed by the drives, may be read from any thread
+    ShadowRegisters& getShadow() { return shadow; }
+    
+    // per-command trace points (enqueue, dequeue, write, first reply byte, crc, handled)
+    // into a ring of the last capacity events. may be called from any thread,
+    // a replaced ring is kept alive so that submitting threads never see it go away
+    void enableTrace(size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        trace_rings.emplace_back(new TraceRing(capacity));
+        trace_ring.store(trace_rings.back().get(), std::memory_order_release);
+    }
+    void disableTrace() { trace_ring.store(nullptr, std::memory_order_release); }
+    bool tracing() const { return trace_ring.load(std::memory_order_relaxed) != nullptr; }
+    
+    // chrome://tracing or ui.perfetto.dev
+    bool writeChromeTrace(const std::string& path)
+    {
+        TraceRing* ring = trace_ring.load(std::memory_order_acquire);
+        return ring && ring->writeChromeTrace(path);
+    }
+    
+    // record every written frame and every received chunk to a binary log
+    bool startCapture(const std::string& path) { return capture.open(path); }
+    void stopCapture() { capture.close(); }
+    bool isCapturing() const { return capture.isOpen(); }
+    
+    // feed a recorded log back instead of the serial port (see CaptureReader)
+    // nothing is written to the port in replay mode
+    void beginReplay() { b_replay = true; }
+    
+    void replay(Direction dir, const uint8_t* data, size_t size)
+    {
+        if (dir == Direction::Rx)
+        {
+            parser.feed(data, size);
+            return;
+        }
+        
+        // only read requests are waiting for a reply
+        RequestType type;
+        if (size != 8 || data[1] != 0x03 || !Request::find((data[2] << 8) | data[3], type)) return;
+        
+        // a request still unanswered when the next one went out has timed out on the bus
+        while (requests.size() && !requests.front().isReceived())
+        {
+            requests.pop_front();
+            ++num_timeouts;
+        }
+        
+        requests.emplace_back(data[0], type);
+        requests.back().requested();
+    }
 	
-    bool available() { return (requests.size()) ? requests.front()->isReceived() : false; }
+    bool available() { return (requests.size()) ? requests.front().isReceived() : false; }
     size_t query_size() { return queries.size(); }
     size_t request_size() { return requests.size(); }
     
-	std::shared_ptr<Request> getResponse() { return requests.front(); }
+    size_t getNumWrites() { return num_writes; }
+    size_t getNumResponses() { return num_responses; }
+    size_t getNumTimeouts() { return num_timeouts; }
+    size_t getNumEchoes() { return num_echoes; }
+    size_t getNumEchoTimeouts() { return num_echo_timeouts; }
+    // frames the transport did not take completely, resolved with Result::Status::WriteError
+    size_t getNumWriteErrors() { return num_write_errors; }
+    size_t getNumCrcErrors() { return parser.getNumCrcErrors(); }
+    // replies whose size does not match their request
+    size_t getNumMalformed() { return num_malformed; }
+    
+    // slowest round trip (write to reply or echo) since the last call
+    Nanos takeMaxLatency()
+    {
+        Nanos l = max_latency;
+        max_latency = 0;
+        return l;
+    }
+    Nanos getLastLatency() { return last_latency; }
+    
+	Request& getResponse() { return requests.front(); }
 	
     
 private:
 	
-    void write(uint8_t* data, size_t size) { ofxSerial::writeBytes(data, size); }
+    struct Submission
+    {
+        enum class Kind { Back, Front, Request, At };
+        Kind kind {Kind::Back};
+        Frame frame;
+        std::shared_ptr<Completion> completion;
+        RequestType type {RequestType::Status};
+        uint8_t id {0};
+        uint64_t trace {0};
+        // RequestType::Block
+        uint16_t addr {0};
+        uint16_t count {0};
+        std::shared_ptr<std::vector<uint16_t>> out;
+        // RequestType::Monitor
+        std::shared_ptr<const ReadMap> map;
+        // Kind::At
+        Nanos at {0};
+        std::function<void(Nanos)> on_written;
+    };
     
-	void handleInput(const Parser::Response& res)
-	{
-        if (!requests.size())
+    // an empty frame is a fence
+    struct Outgoing
+    {
+        Frame frame;
+        std::shared_ptr<Completion> completion;
+        uint64_t trace;
+    };
+    
+    struct Timed
+    {
+        Outgoing out;
+        Nanos at;
+        std::function<void(Nanos)> on_written;
+    };
+    
+    // unicast write waiting for its echo
+    struct Echo
+    {
+        uint8_t id {0};
+        std::shared_ptr<Completion> completion;
+        size_t ticks {0};
+        Nanos sent {0};
+        uint64_t trace {0};
+        // what was written
+        Frame frame;
+    };
+    
+    struct EStop
+    {
+        Frame frame;
+        std::shared_ptr<Completion> completion;
+        size_t repeats {0};
+        Nanos called {0};
+    };
+    
+    static void resolve(const std::shared_ptr<Completion>& c, Result::Status status, uint8_t exception = 0)
+    {
+        if (c) c->resolve(status, 0, exception);
+    }
+    
+    Handle submit(Submission::Kind kind, const Frame& f, Completion::Callback on_done, RequestType r = RequestType::Status, uint8_t id = 0)
+    {
+        return submit(Submission(), kind, f, on_done, r, id);
+    }
+    
+    Handle submit(Submission s, Submission::Kind kind, const Frame& f, Completion::Callback on_done, RequestType r, uint8_t id)
+    {
+        s.kind = kind;
+        s.frame = f;
+        s.completion = std::make_shared<Completion>(std::move(on_done));
+        s.type = r;
+        s.id = (kind == Submission::Kind::Request || f.empty()) ? id : f.getID();
+        if (TraceRing* ring = trace_ring.load(std::memory_order_acquire))
         {
-            parser.pop();
-            return;
+            s.trace = next_trace.fetch_add(1, std::memory_order_relaxed);
+            ring->record(s.trace, s.id, TracePoint::Enqueue, nowNanos());
+        }
+        Handle h(s.completion);
+        num_pending.fetch_add(1, std::memory_order_release);
+        submissions.push(std::move(s));
+        if (waker) waker();
+        return h;
+    }
+    
+    void drain()
+    {
+        Submission s;
+        while (submissions.pop(s))
+        {
+            num_pending.fetch_sub(1, std::memory_order_release);
+            if (!isOpen())
+            {
+                resolve(s.completion, Result::Status::Cancelled);
+                continue;
+            }
+            trace(s.trace, s.id, TracePoint::Dequeue);
+            switch (s.kind)
+            {
+                case Submission::Kind::Back:  queries.push_back({ s.frame, s.completion, s.trace }); break;
+                case Submission::Kind::Front: queries.push_front({ s.frame, s.completion, s.trace }); break;
+                case Submission::Kind::At:
+                {
+                    auto it = std::upper_bound(timed.begin(), timed.end(), s.at, [](Nanos t, const Timed& x) { return t < x.at; });
+                    timed.insert(it, Timed { { s.frame, s.completion, s.trace }, s.at, s.on_written });
+                    break;
+                }
+                case Submission::Kind::Request:
+                {
+                    // drop half received garbage, but never a reply which is on its way
+                    if (requests.empty() && echoes.empty()) parser.clear();
+                    if (s.type == RequestType::Block) requests.emplace_back(s.id, s.addr, s.count, s.out);
+                    else if (s.map) requests.emplace_back(s.id, s.map);
+                    else requests.emplace_back(s.id, s.type);
+                    requests.back().setCompletion(s.completion);
+                    requests.back().setTraceID(s.trace);
+                    break;
+                }
+            }
         }
         
-		auto& req = requests.front();
-		uint32_t p = 0;
-		p |= (res.data[0] << 24) & 0xFF000000;
-		p |= (res.data[1] << 16) & 0x00FF0000;
-		p |= (res.data[2] <<  8) & 0x0000FF00;
-		p |= (res.data[3] <<  0) & 0x000000FF;
-		req->setResponse(p);
+        EStop e;
+        while (estop_submissions.pop(e))
+        {
+            num_pending.fetch_sub(1, std::memory_order_release);
+            if (!isOpen())
+            {
+                resolve(e.completion, Result::Status::Cancelled);
+                continue;
+            }
+            cancelAll();
+            estops.push_back(std::move(e));
+        }
+    }
+    
+    void cancelAll()
+    {
+        if (requests.empty() && queries.empty() && timed.empty()) return;
+        logWarning("ofxModbusOriental") << "emergency stop : cancelled " << requests.size() << " requests and " << queries.size() + timed.size() << " queries";
+        for (auto& r : requests) r.resolve(Result::Status::Cancelled);
+        for (auto& q : queries) resolve(q.completion, Result::Status::Cancelled);
+        for (auto& t : timed) resolve(t.out.completion, Result::Status::Cancelled);
+        requests.clear();
+        queries.clear();
+        timed.clear();
+    }
+    
+    // no reply is on its way
+    bool quiet()
+    {
+        return echoes.empty() && (requests.empty() || !requests.front().isRequested());
+    }
+    
+    bool writeQuery(Outgoing& out)
+    {
+        const uint8_t* data = out.frame.data();
+        if (!write(data, out.frame.size()))
+        {
+            // part of it may have reached the drives
+            shadow.invalidateWrite(data, out.frame.size(), nowNanos(), !replies[data[0]]);
+            resolve(out.completion, Result::Status::WriteError);
+            return false;
+        }
+        trace(out.trace, data[0], TracePoint::Write);
+        // broadcast and group addresses are never answered, unicast writes are echoed back
+        if (!replies[data[0]])
+        {
+            shadow.invalidateWrite(data, out.frame.size(), nowNanos(), true);
+            resolve(out.completion, Result::Status::Done);
+            trace(out.trace, data[0], TracePoint::Handled);
+        }
+        else
+        {
+            Echo e;
+            e.id = data[0];
+            e.completion = out.completion;
+            e.sent = nowNanos();
+            e.trace = out.trace;
+            e.frame = out.frame;
+            echoes.push_back(e);
+        }
+        return true;
+    }
+    
+    void writeTimed()
+    {
+        Timed t = std::move(timed.front());
+        timed.pop_front();
+        if (writeQuery(t.out) && t.on_written) t.on_written(nowNanos());
+        ticker.reset(); // a full interval before the next frame
+    }
+    
+    void writeStop()
+    {
+        EStop& s = estops.front();
+        const uint8_t* data = s.frame.data();
+        if (!write(data, s.frame.size()))
+        {
+            // a repeat, if any, tries again at the next tick
+            resolve(s.completion, Result::Status::WriteError);
+            s.completion.reset();
+            if (s.repeats == 0) estops.pop_front();
+            else --s.repeats;
+            return;
+        }
+        Nanos now = nowNanos();
+        if (s.called)
+        {
+            Nanos l = now - s.called;
+            stop_latency_last.store(l, std::memory_order_relaxed);
+            if (l > stop_latency_max.load(std::memory_order_relaxed)) stop_latency_max.store(l, std::memory_order_relaxed);
+            stop_latency_count.fetch_add(1, std::memory_order_release);
+            s.called = 0;
+        }
+        if (!replies[data[0]])
+        {
+            shadow.invalidateWrite(data, s.frame.size(), now, true);
+            resolve(s.completion, Result::Status::Done);
+        }
+        else
+        {
+            // every repeat is echoed, only the first one resolves the handle
+            Echo e;
+            e.id = data[0];
+            e.completion = s.completion;
+            e.sent = now;
+            e.frame = s.frame;
+            echoes.push_back(e);
+        }
+        s.completion.reset();
+        if (s.repeats == 0) estops.pop_front();
+        else --s.repeats;
+    }
+    
+    void ageEchoes()
+    {
+        for (auto& e : echoes) ++e.ticks;
+        while (echoes.size() && echoes.front().ticks > timeout_tick)
+        {
+            logError("ofxModbusOriental") << "Write Echo Timeout!! " << (int)echoes.front().id;
+            shadow.invalidateWrite(echoes.front().frame.data(), echoes.front().frame.size(), nowNanos());
+            resolve(echoes.front().completion, Result::Status::Timeout);
+            echoes.pop_front();
+            ++num_echo_timeouts;
+        }
+    }
+    
+    static std::array<bool, 256> initReplies()
+    {
+        std::array<bool, 256> r;
+        r.fill(true);
+        r[0] = false;
+        return r;
+    }
+    
+    // trace id 0 : submitted while tracing was off
+    void trace(uint64_t id, uint8_t addr, TracePoint point, Nanos time = 0)
+    {
+        if (id == 0) return;
+        if (TraceRing* ring = trace_ring.load(std::memory_order_acquire)) ring->record(id, addr, point, time ? time : nowNanos());
+    }
+    
+    void traceReply(uint64_t id, const Parser::Response& res)
+    {
+        if (id == 0 || !res.first_byte) return;
+        trace(id, res.addr, TracePoint::FirstByte, res.first_byte);
+        trace(id, res.addr, TracePoint::CrcComplete, res.complete);
+    }
+    
+    void observeLatency(Nanos l)
+    {
+        last_latency = l;
+        max_latency = std::max(max_latency, l);
+    }
+    
+    // the whole frame or an error : a short write would leave a truncated frame on the bus
+    bool write(const uint8_t* data, size_t size)
+    {
+        long n = transport->writeAll(data, size, write_timeout);
+        if (n > 0) capture.record(Direction::Tx, data, n);
+        if (n == (long)size)
+        {
+            ++num_writes;
+            return true;
+        }
+        logError("ofxModbusOriental") << "Write Error!! " << (int)data[0] << " : " << n << " of " << size << " bytes written";
+        ++num_write_errors;
+        return false;
+    }
+    
+	void handleInput(const Parser::Response& res)
+	{
+        if (res.function() == 0x03) handleRead(res);
+        else handleEcho(res);
 		parser.pop();
 	}
 	
+	void handleRead(const Parser::Response& res)
+	{
+        if (!requests.size() || !requests.front().isRequested() || requests.front().isReceived()) return;
+        
+		Request& req = requests.front();
+        if (req.getID() != res.addr) return; // late reply to a request which already timed out
+        
+        if (res.isException())
+        {
+            req.setException(res.data[0]);
+            traceReply(req.getTraceID(), res);
+        }
+        else if (req.getKey() == RequestType::Block)
+        {
+            if (res.data.size() != 2 * (size_t)req.getRegCount())
+            {
+                logError("ofxModbusOriental") << "reply of " << res.data.size() << " bytes from " << (int)res.addr
+                    << ", expected " << 2 * (int)req.getRegCount();
+                req.resolve(Result::Status::Invalid);
+                requests.pop_front();
+                ++num_malformed;
+                return;
+            }
+            req.setRegisters(res.data);
+            req.setResponse(req.getRegCount());
+            traceReply(req.getTraceID(), res);
+            Nanos now = nowNanos();
+            shadow.confirmRegisters(req.getID(), req.getAddr(), res.data.data(), res.data.size() / 2, now);
+            if (!b_replay) observeLatency(now - req.getRequestedTime());
+        }
+        else
+        {
+            // the reply must carry exactly the registers of the map
+            const ReadMap* map = req.getMap();
+            if (!map || res.size != res.data.size() || res.data.size() != 2 * (size_t)map->words)
+            {
+                logError("ofxModbusOriental") << "reply of " << res.data.size() << " bytes from " << (int)res.addr
+                    << ", expected " << (map ? 2 * (int)map->words : 0);
+                req.resolve(Result::Status::Invalid);
+                requests.pop_front();
+                ++num_malformed;
+                return;
+            }
+            req.setDecoded(res.data.data());
+            traceReply(req.getTraceID(), res);
+            Nanos now = nowNanos();
+            shadow.confirmRegisters(req.getID(), map->address, res.data.data(), map->words, now);
+            if (!b_replay) observeLatency(now - req.getRequestedTime());
+        }
+		++num_responses;
+	}
+	
+	void handleEcho(const Parser::Response& res)
+	{
+        auto it = std::find_if(echoes.begin(), echoes.end(), [&](const Echo& e) { return e.id == res.addr; });
+        if (it == echoes.end()) return;
+        traceReply(it->trace, res);
+        if (res.isException())
+        {
+            shadow.invalidateWrite(it->frame.data(), it->frame.size(), nowNanos());
+            resolve(it->completion, Result::Status::Exception, res.data[0]);
+        }
+        else
+        {
+            shadow.confirmWrite(it->frame.data(), it->frame.size(), nowNanos());
+            observeLatency(nowNanos() - it->sent);
+            resolve(it->completion, Result::Status::Done);
+        }
+        trace(it->trace, it->id, TracePoint::Handled);
+        echoes.erase(it);
+        ++num_echoes;
+	}
+	
+    std::shared_ptr<Transport> transport;
     Parser parser;
 	Ticker ticker {0.1};
+    Capture capture;
+    ShadowRegisters shadow;
+    std::array<bool, 256> replies {initReplies()};
+    bool b_replay {false};
 	
-	std::deque<std::shared_ptr<Query>> queries;
-	std::deque<std::shared_ptr<Request>> requests;
+	std::deque<Outgoing> queries;
+	std::deque<Request> requests;
+	std::deque<Echo> echoes;
+	MpscQueue<Submission> submissions;
+	MpscQueue<EStop> estop_submissions;
+	std::deque<EStop> estops;
+	std::deque<Timed> timed;
+	std::atomic<Nanos> stop_latency_last {0};
+	std::atomic<Nanos> stop_latency_max {0};
+	std::atomic<size_t> stop_latency_count {0};
+	std::atomic<size_t> num_pending {0};
+	std::function<void()> waker;
+	
+	std::atomic<TraceRing*> trace_ring {nullptr};
+	std::vector<std::unique_ptr<TraceRing>> trace_rings;
+	std::mutex trace_mutex;
+	std::atomic<uint64_t> next_trace {1};
 	
 	size_t timeout_tick {3};
+	static constexpr Nanos write_timeout = 20000000; // for room in a full port
+	
+	size_t num_writes {0};
+	size_t num_responses {0};
+	size_t num_timeouts {0};
+	size_t num_echoes {0};
+	size_t num_echo_timeouts {0};
+	size_t num_write_errors {0};
+	size_t num_malformed {0};
+	Nanos last_latency {0};
+	Nanos max_latency {0};
 };
 
 OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
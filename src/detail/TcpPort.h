@@ -0,0 +1,125 @@
+#ifndef OFXMODBUSORIENTAL_TCPPORT_H
+#define OFXMODBUSORIENTAL_TCPPORT_H
+
+#include <string>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "Transport.h"
+#include "Log.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// modbus RTU over TCP : the same RTU frames (with crc) carried over a TCP stream,
+// as Ethernet to RS-485 gateways do in transparent mode. one TcpPort per gateway port = one bus.
+// timing on the RS-485 side is the gateway's business, keep the interval above its latency.
+class TcpPort : public Transport
+{
+public:
+
+    TcpPort() {}
+    TcpPort(const std::string& host, uint16_t port, double timeout_sec = 1.0)
+    {
+        open(host, port, timeout_sec);
+    }
+    virtual ~TcpPort() { close(); }
+
+    bool open(const std::string& host, uint16_t port, double timeout_sec = 1.0)
+    {
+        close();
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+        {
+            logError("ofxModbusOriental") << "could not resolve " << host;
+            return false;
+        }
+        for (addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next)
+        {
+            fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            if (!connect(ai->ai_addr, ai->ai_addrlen, timeout_sec)) close();
+        }
+        freeaddrinfo(res);
+        if (fd < 0)
+        {
+            logError("ofxModbusOriental") << "could not connect to " << host << ":" << port;
+            return false;
+        }
+        // a frame is one write, send it now instead of waiting for more
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        return true;
+    }
+
+    virtual bool isOpen() override { return fd >= 0; }
+
+    virtual size_t available() override
+    {
+        int n = 0;
+        if (fd < 0 || ioctl(fd, FIONREAD, &n) != 0) return 0;
+        if (n == 0)
+        {
+            // readable with nothing to read : the gateway closed the connection
+            pollfd p { fd, POLLIN, 0 };
+            uint8_t b;
+            if (::poll(&p, 1, 0) > 0 && ::recv(fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+            {
+                logError("ofxModbusOriental") << "connection closed by peer";
+                close();
+            }
+        }
+        return (size_t)n;
+    }
+
+    virtual long read(uint8_t* data, size_t size) override { return (fd < 0) ? -1 : ::recv(fd, data, size, MSG_DONTWAIT); }
+
+    virtual long write(const uint8_t* data, size_t size) override
+    {
+#ifdef MSG_NOSIGNAL
+        return (fd < 0) ? -1 : ::send(fd, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+        return (fd < 0) ? -1 : ::send(fd, data, size, MSG_DONTWAIT);
+#endif
+    }
+
+    virtual void close() override
+    {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    virtual int getFd() override { return fd; }
+
+private:
+
+    bool connect(const sockaddr* addr, socklen_t len, double timeout_sec)
+    {
+        if (::connect(fd, addr, len) == 0) return true;
+        if (errno != EINPROGRESS) return false;
+        pollfd p { fd, POLLOUT, 0 };
+        if (::poll(&p, 1, (int)(timeout_sec * 1000)) <= 0) return false;
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        return getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 && err == 0;
+    }
+
+    int fd {-1};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_TCPPORT_H */
@@ -0,0 +1,129 @@
+#ifndef OFXMODBUSORIENTAL_TRACE_H
+#define OFXMODBUSORIENTAL_TRACE_H
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Utils.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// per-command latency trace points, in the order a command goes through them
+enum class TracePoint : uint8_t
+{
+    Enqueue,     // submitted (any thread)
+    Dequeue,     // taken over by the update() thread
+    Write,       // written to the transport
+    FirstByte,   // first byte of its reply arrived
+    CrcComplete, // reply parsed with a valid crc
+    Handled      // reply handled, completion resolved
+};
+
+// fixed size ring of trace events, lock-free for many writers.
+// each slot carries a stamp so that a dump never reads a half written event.
+// when it is full the oldest events are overwritten
+class TraceRing
+{
+public:
+
+    struct Event
+    {
+        uint64_t cmd;
+        Nanos time;
+        uint8_t id;
+        TracePoint point;
+    };
+
+    explicit TraceRing(size_t capacity) : slots(new Slot[std::max<size_t>(capacity, 1)]), capacity(std::max<size_t>(capacity, 1)) {}
+
+    void record(uint64_t cmd, uint8_t id, TracePoint point, Nanos time)
+    {
+        uint64_t n = head.fetch_add(1, std::memory_order_relaxed);
+        Slot& s = slots[n % capacity];
+        s.stamp.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.cmd.store(cmd, std::memory_order_relaxed);
+        s.time.store(time, std::memory_order_relaxed);
+        s.info.store(((uint32_t)id << 8) | (uint32_t)point, std::memory_order_relaxed);
+        s.stamp.store(n + 1, std::memory_order_release);
+    }
+
+    // copies the events currently in the ring, oldest first
+    std::vector<Event> snapshot() const
+    {
+        std::vector<Event> events;
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t begin = (end > capacity) ? end - capacity : 0;
+        events.reserve(end - begin);
+        for (uint64_t n = begin; n < end; ++n)
+        {
+            const Slot& s = slots[n % capacity];
+            uint64_t stamp = s.stamp.load(std::memory_order_acquire);
+            Event e;
+            e.cmd = s.cmd.load(std::memory_order_relaxed);
+            e.time = s.time.load(std::memory_order_relaxed);
+            uint32_t info = s.info.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (stamp != n + 1 || s.stamp.load(std::memory_order_relaxed) != stamp) continue;
+            e.id = (uint8_t)(info >> 8);
+            e.point = (TracePoint)(info & 0xFF);
+            events.push_back(e);
+        }
+        return events;
+    }
+
+    // chrome://tracing or https://ui.perfetto.dev
+    // one row per drive id, one span per step between consecutive trace points of a command
+    bool writeChromeTrace(const std::string& path) const
+    {
+        static const char* names[] { "queued", "scheduled", "on the bus", "receiving", "dispatch" };
+
+        std::vector<Event> events = snapshot();
+        std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+        {
+            return (a.cmd != b.cmd) ? a.cmd < b.cmd : a.point < b.point;
+        });
+
+        std::ofstream ofs(path);
+        if (!ofs) return false;
+        ofs << std::fixed << std::setprecision(3);
+        ofs << "{\"traceEvents\":[";
+        bool b_first = true;
+        for (size_t i = 1; i < events.size(); ++i)
+        {
+            const Event& a = events[i - 1];
+            const Event& b = events[i];
+            if (a.cmd != b.cmd || b.point <= a.point || b.time < a.time) continue;
+            if (!b_first) ofs << ",";
+            b_first = false;
+            ofs << "\n{\"name\":\"" << names[(size_t)b.point - 1] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (int)a.id
+                << ",\"ts\":" << (double)a.time * 1e-3 << ",\"dur\":" << (double)(b.time - a.time) * 1e-3
+                << ",\"args\":{\"cmd\":" << a.cmd << "}}";
+        }
+        ofs << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+        return (bool)ofs;
+    }
+
+private:
+
+    struct Slot
+    {
+        std::atomic<uint64_t> stamp {0};
+        std::atomic<uint64_t> cmd {0};
+        std::atomic<Nanos> time {0};
+        std::atomic<uint32_t> info {0};
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity;
+    std::atomic<uint64_t> head {0};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_TRACE_H */
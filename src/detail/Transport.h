@@ -0,0 +1,65 @@
+#ifndef OFXMODBUSORIENTAL_TRANSPORT_H
+#define OFXMODBUSORIENTAL_TRANSPORT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <thread>
+#ifndef _WIN32
+#include <poll.h>
+#endif
+#include "Utils.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// byte pipe under Stream
+// read() and write() must not block, read() returns what has arrived so far,
+// write() may take part of the data (see writeAll())
+class Transport
+{
+public:
+    virtual ~Transport() {}
+    virtual bool isOpen() = 0;
+    virtual size_t available() = 0;
+    virtual long read(uint8_t* data, size_t size) = 0;
+    virtual long write(const uint8_t* data, size_t size) = 0;
+    virtual void close() = 0;
+    // pollable descriptor for event driven I/O (see IoThread), -1 if there is none
+    virtual int getFd() { return -1; }
+
+    // write() until all size bytes are taken, waiting for room when the port is full (EAGAIN)
+    // or took part of them. returns the bytes written, less than size on error or timeout
+    long writeAll(const uint8_t* data, size_t size, Nanos timeout)
+    {
+        size_t done = 0;
+        Nanos until = nowNanos() + timeout;
+        while (done < size)
+        {
+            errno = 0;
+            long n = write(data + done, size - done);
+            if (n > 0)
+            {
+                done += n;
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) break;
+            Nanos left = until - nowNanos();
+            if (left <= 0) break;
+#ifndef _WIN32
+            int fd = getFd();
+            if (fd >= 0)
+            {
+                pollfd p { fd, POLLOUT, 0 };
+                ::poll(&p, 1, (int)((left + 999999) / 1000000));
+                continue;
+            }
+#endif
+            std::this_thread::yield();
+        }
+        return (long)done;
+    }
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_TRANSPORT_H */
@@ -2,46 +2,83 @@
 #define OFXMODBUSORIENTAL_UTILS_H
 
 #include <cstdint>
+#include <cstddef>
+#include <chrono>
 #include <vector>
 
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// monotonic time in integer nanoseconds, safe for months of uptime
+using Nanos = int64_t;
+
+inline Nanos nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline Nanos toNanos(double sec) { return (Nanos)(sec * 1e9); }
+inline double toSec(Nanos ns) { return (double)ns * 1e-9; }
+
 class Ticker
 {
 public:
-    
-    Ticker(float interval) : curr(0.f), prev(0.f), interval(interval) { }
-    
+
+    Ticker(double interval) : curr(0), prev(0), interval(toNanos(interval)) { }
+
     bool tick()
     {
-        curr = ofGetElapsedTimef();
+        curr = nowNanos();
         if (curr - prev < interval) return false;
-        while (curr - prev >= interval) prev += interval;
+        // skip the missed intervals at once, phase stays locked to reset()
+        prev += (interval > 0) ? ((curr - prev) / interval) * interval : curr - prev;
         return true;
     }
-    
-    void reset() { curr = prev = ofGetElapsedTimef(); }
-    
-    float now() { return curr - prev;}
-    
-    void setInterval(float interval) { this->interval = interval; }
-    
+
+    void reset() { curr = prev = nowNanos(); }
+
+    double now() { return toSec(curr - prev); }
+
+    void setInterval(double interval) { this->interval = toNanos(interval); }
+
+    Nanos getInterval() const { return interval; }
+
+    // steady_clock time of the next tick
+    Nanos next() const { return prev + interval; }
+
 private:
-    
-    float curr;
-    float prev;
-    float interval;
-    
+
+    Nanos curr;
+    Nanos prev;
+    Nanos interval;
+
 };
 
+// modbus crc-16 (poly 0xA001, init 0xFFFF)
+inline uint16_t crc16(const uint8_t* data, size_t size)
+{
+    uint16_t result = 0xFFFF;
+    for (size_t i = 0; i < size; ++i)
+    {
+        result ^= data[i];
+        for (size_t j = 0; j < 8; ++j)
+        {
+            if (result & 0x01) result = (result >> 1) ^ 0xA001;
+            else result >>= 1;
+        }
+    }
+    return result;
+}
+
 class CrcGenerator
 {
-    vector<uint8_t> elements;
-    
+    std::vector<uint8_t> elements;
+
 public:
-    
+
     void push(uint8_t v) { elements.push_back(v); }
-    
+
     void clear() { elements.clear(); }
-    
+
     uint16_t get()
     {
         uint16_t result = 0xFFFF;
@@ -56,22 +93,10 @@ public:
         }
         return result;
     }
-    
-    uint16_t get(uint8_t* data, size_t size)
-    {
-        uint16_t result = 0xFFFF;
-        for (size_t i = 0; i < size; ++i)
-        {
-            result ^= data[i];
-            for (size_t j = 0; j < 8; ++j)
-            {
-                if (result & 0x01) result = (result >> 1) ^ 0xA001;
-                else result >>= 1;
-            }
-        }
-        return result;
-    }
+
+    uint16_t get(const uint8_t* data, size_t size) { return crc16(data, size); }
 };
 
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
 
 #endif /* OFXMODBUSORIENTAL_UTILS_H */
@@ -0,0 +1,216 @@
+#ifndef OFXMODBUSORIENTAL_VELOCITYSTREAM_H
+#define OFXMODBUSORIENTAL_VELOCITYSTREAM_H
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include "Utils.h"
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+
+// velocity setpoints of a continuous (speed control) operation, streamed at a fixed rate.
+// set() only overwrites the newest setpoint of an axis, lock-free from any thread.
+// at each tick the update() thread takes the newest one of every axis whose previous frame
+// has been echoed, so at most one frame per axis is queued and it is never older than one tick.
+// an axis whose setpoints stop for longer than the timeout gets velocity 0 once,
+// and the drive ramps down with its deceleration
+template <size_t Size>
+class VelocityStream
+{
+public:
+
+    // a frame to write : velocity of axis id, and when its setpoint was set
+    struct Send
+    {
+        uint8_t id;
+        int32_t vel;
+        Nanos set_time;
+        bool b_ramp; // setpoints stopped, ramping down
+        uint32_t epoch; // of the axis when sent, frames from before a halt() are stale
+    };
+
+    // setpoint set() to its frame echoed by the drive
+    struct Latency
+    {
+        Nanos last {0};
+        Nanos max {0};
+        Nanos sum {0};
+        size_t count {0};
+
+        Nanos mean() const { return count ? sum / (Nanos)count : 0; }
+    };
+
+    VelocityStream()
+    {
+        for (auto& s : setpoints) s.store(0, std::memory_order_relaxed);
+        for (auto& t : set_times) t.store(0, std::memory_order_relaxed);
+        for (auto& a : active) a.store(false, std::memory_order_relaxed);
+        for (auto& h : halted) h.store(false, std::memory_order_relaxed);
+    }
+
+    // any thread
+    void set(uint8_t id, int32_t vel, Nanos now)
+    {
+        uint32_t seq = next_seq.fetch_add(1, std::memory_order_relaxed);
+        set_times[id].store(now, std::memory_order_relaxed);
+        setpoints[id].store(((uint64_t)(uint32_t)vel << 32) | seq, std::memory_order_release);
+    }
+
+    void activate(uint8_t id, bool b) { active[id].store(b, std::memory_order_release); }
+    bool isActive(uint8_t id) const { return active[id].load(std::memory_order_acquire); }
+    
+    // any thread : stops streaming without the ramp down frame, the drive was stopped otherwise.
+    // the frame in flight is dropped, whatever becomes of it
+    void halt(uint8_t id)
+    {
+        active[id].store(false, std::memory_order_release);
+        halted[id].store(true, std::memory_order_release);
+    }
+
+    void setPeriod(Nanos p) { period.store(std::max<Nanos>(p, 1), std::memory_order_relaxed); }
+    void setTimeout(Nanos t) { timeout.store(t, std::memory_order_relaxed); }
+    Nanos getPeriod() const { return period.load(std::memory_order_relaxed); }
+
+    // update() thread : calls f(Send) for every frame due at this tick
+    template <typename F>
+    void tick(Nanos now, F f)
+    {
+        for (size_t i = 1; i <= Size; ++i)
+        {
+            if (!halted[i].exchange(false, std::memory_order_acq_rel)) continue;
+            Axis& a = axes[i];
+            a.b_moving = a.b_in_flight = a.b_sent = false;
+            ++a.epoch;
+        }
+        if (now < next_tick || !running()) return;
+        Nanos p = period.load(std::memory_order_relaxed);
+        next_tick = (now - next_tick < p) ? next_tick + p : now + p;
+
+        Nanos to = timeout.load(std::memory_order_relaxed);
+        for (size_t i = 1; i <= Size; ++i)
+        {
+            Axis& a = axes[i];
+            if (!active[i].load(std::memory_order_acquire))
+            {
+                if (a.b_moving && !a.b_in_flight) send(i, 0, now, true, f); // stopped streaming : ramp down
+                continue;
+            }
+            if (a.b_in_flight) continue;
+
+            uint64_t sp = setpoints[i].load(std::memory_order_acquire);
+            uint32_t seq = (uint32_t)sp;
+            int32_t vel = (int32_t)(uint32_t)(sp >> 32);
+            Nanos set_time = set_times[i].load(std::memory_order_relaxed);
+            if (seq != a.seq || !a.b_sent)
+            {
+                // a new setpoint, sent only when it differs from what the drive runs
+                a.seq = seq;
+                a.last_alive = now;
+                if (vel != a.vel || !a.b_sent) send(i, vel, set_time, false, f);
+            }
+            else if (a.b_moving && now - a.last_alive > to)
+            {
+                send(i, 0, now, true, f);
+            }
+        }
+    }
+
+    // update() thread : the frame of s was echoed (b_ok) or failed
+    void confirm(const Send& s, bool b_ok, Nanos now)
+    {
+        Axis& a = axes[s.id];
+        if (s.epoch != a.epoch) return;
+        a.b_in_flight = false;
+        if (!b_ok)
+        {
+            // retried at the next tick
+            if (s.b_ramp) a.b_moving = true;
+            else a.b_sent = false;
+            return;
+        }
+        if (s.b_ramp) return;
+        Nanos l = now - s.set_time;
+        latency_last.store(l, std::memory_order_relaxed);
+        if (l > latency_max.load(std::memory_order_relaxed)) latency_max.store(l, std::memory_order_relaxed);
+        latency_sum.fetch_add(l, std::memory_order_relaxed);
+        latency_count.fetch_add(1, std::memory_order_release);
+    }
+
+    // true while any axis is streaming or still ramping down
+    bool running() const
+    {
+        for (size_t i = 1; i <= Size; ++i)
+            if (active[i].load(std::memory_order_relaxed) || axes[i].b_moving || axes[i].b_in_flight) return true;
+        return false;
+    }
+
+    // steady_clock time [ns] of the next tick, -1 when nothing streams
+    Nanos deadline() const { return running() ? next_tick : -1; }
+
+    Latency getLatency() const
+    {
+        Latency l;
+        l.last = latency_last.load(std::memory_order_relaxed);
+        l.max = latency_max.load(std::memory_order_relaxed);
+        l.sum = latency_sum.load(std::memory_order_relaxed);
+        l.count = latency_count.load(std::memory_order_acquire);
+        return l;
+    }
+    void resetLatency()
+    {
+        latency_last.store(0);
+        latency_max.store(0);
+        latency_sum.store(0);
+        latency_count.store(0);
+    }
+
+    // ramp downs because the setpoints stopped
+    size_t getNumTimeouts() const { return num_timeouts.load(std::memory_order_relaxed); }
+
+private:
+
+    struct Axis
+    {
+        uint32_t seq {0};
+        uint32_t epoch {0};   // halt() count
+        int32_t vel {0};      // last sent
+        Nanos last_alive {0}; // last new setpoint
+        bool b_sent {false};
+        bool b_moving {false};
+        bool b_in_flight {false};
+    };
+
+    template <typename F>
+    void send(size_t i, int32_t vel, Nanos set_time, bool b_ramp, F& f)
+    {
+        Axis& a = axes[i];
+        if (b_ramp && active[i].load(std::memory_order_relaxed)) num_timeouts.fetch_add(1, std::memory_order_relaxed);
+        a.vel = vel;
+        a.b_sent = true;
+        a.b_moving = (vel != 0);
+        a.b_in_flight = true;
+        f(Send { (uint8_t)i, vel, set_time, b_ramp, a.epoch });
+    }
+
+    std::array<std::atomic<uint64_t>, Size + 1> setpoints; // velocity << 32 | sequence
+    std::array<std::atomic<Nanos>, Size + 1> set_times;
+    std::array<std::atomic<bool>, Size + 1> active;
+    std::array<std::atomic<bool>, Size + 1> halted;
+    std::atomic<uint32_t> next_seq {1};
+    std::atomic<Nanos> period {20000000};
+    std::atomic<Nanos> timeout {200000000};
+
+    std::array<Axis, Size + 1> axes;
+    Nanos next_tick {0};
+
+    std::atomic<Nanos> latency_last {0};
+    std::atomic<Nanos> latency_max {0};
+    std::atomic<Nanos> latency_sum {0};
+    std::atomic<size_t> latency_count {0};
+    std::atomic<size_t> num_timeouts {0};
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+
+#endif /* OFXMODBUSORIENTAL_VELOCITYSTREAM_H */
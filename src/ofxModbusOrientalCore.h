@@ -0,0 +1,39 @@
+#ifndef OFXMODBUSORIENTALCORE_H
+#define OFXMODBUSORIENTALCORE_H
+
+// openFrameworks independent part of ofxModbusOriental
+// include this alone to use ControllerCore in a headless process
+
+#define OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN namespace ofxModbusOriental {
+#define OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END }
+
+#include <stdint.h>
+#include <cstddef>
+#include <array>
+
+struct EnumClassHash
+{
+    template <typename T>
+    std::size_t operator() (T t) const noexcept
+    {
+        return static_cast<std::size_t>(t);
+    }
+};
+
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_BEGIN
+OFX_MODBUS_ORIENTAL_MOTOR_NAMESPACE_END
+namespace ofxOriental = ofxModbusOriental;
+
+#include "detail/ControllerCore.h"
+#include "detail/ProgramCache.h"
+#include "detail/Parameters.h"
+#include "detail/BusSync.h"
+#include "detail/Show.h"
+// posix transports, on windows give begin() your own Transport (Controller uses ofxSerial)
+#ifndef _WIN32
+#include "detail/SerialPort.h"
+#include "detail/PtyPort.h"
+#include "detail/TcpPort.h"
+#endif
+
+#endif /* OFXMODBUSORIENTALCORE_H */
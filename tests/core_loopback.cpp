@@ -0,0 +1,212 @@
+// ControllerCore over a PtyPort, with a minimal drive on the other side of the pty :
+// a read request is answered, a write is echoed, and a drive which stays silent times out
+
+#include "ofxModbusOrientalCore.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace ofxOriental;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::printf("FAILED %s:%d : %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+// answers id 1 only : status 0x00002020 to reads, the frame itself to writes
+class Drive
+{
+public:
+    
+    bool open(const std::string& name)
+    {
+        fd = ::open(name.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (fd < 0) return false;
+        termios tio;
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+        b_running = true;
+        th = std::thread([this] { run(); });
+        return true;
+    }
+    
+    void close()
+    {
+        b_running = false;
+        if (th.joinable()) th.join();
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+    
+    std::atomic<size_t> num_frames {0};
+    
+private:
+    
+    void run()
+    {
+        std::vector<uint8_t> buf;
+        while (b_running)
+        {
+            pollfd p { fd, POLLIN, 0 };
+            if (::poll(&p, 1, 10) <= 0) continue;
+            uint8_t rx[256];
+            long n = ::read(fd, rx, sizeof(rx));
+            if (n > 0) buf.insert(buf.end(), rx, rx + n);
+            while (size_t size = frameSize(buf))
+            {
+                std::vector<uint8_t> f(buf.begin(), buf.begin() + size);
+                buf.erase(buf.begin(), buf.begin() + size);
+                ++num_frames;
+                if (f[0] == 1) reply(f);
+            }
+        }
+    }
+    
+    // 0 while incomplete
+    static size_t frameSize(const std::vector<uint8_t>& b)
+    {
+        if (b.size() < 2) return 0;
+        size_t size = (b[1] == 0x10) ? ((b.size() < 7) ? 0 : 9 + b[6]) : 8;
+        return (size && b.size() >= size) ? size : 0;
+    }
+    
+    void reply(const std::vector<uint8_t>& f)
+    {
+        std::vector<uint8_t> r;
+        if (f[1] == 0x03) r = { f[0], 0x03, 4, 0x00, 0x00, 0x20, 0x20 };
+        else r.assign(f.begin(), f.begin() + 6);
+        uint16_t c = crc16(r.data(), r.size());
+        r.push_back(c & 0xFF);
+        r.push_back(c >> 8);
+        long n = ::write(fd, r.data(), r.size());
+        (void)n;
+    }
+    
+    int fd {-1};
+    std::atomic<bool> b_running {false};
+    std::thread th;
+};
+
+// takes at most 5 bytes per write(), every other call it is full (EAGAIN).
+// b_broken : the port refuses everything
+class ChokedPort : public Transport
+{
+public:
+    
+    explicit ChokedPort(bool b_broken = false) : b_broken(b_broken) {}
+    
+    virtual bool isOpen() override { return true; }
+    virtual size_t available() override { return 0; }
+    virtual long read(uint8_t*, size_t) override { return 0; }
+    virtual long write(const uint8_t* data, size_t size) override
+    {
+        if (b_broken || (++calls & 1))
+        {
+            errno = b_broken ? EIO : EAGAIN;
+            return -1;
+        }
+        size_t n = std::min<size_t>(size, 5);
+        bytes.insert(bytes.end(), data, data + n);
+        return (long)n;
+    }
+    virtual void close() override {}
+    
+    std::vector<uint8_t> bytes;
+    
+private:
+    
+    bool b_broken;
+    size_t calls {0};
+};
+
+static void testShortWrites()
+{
+    auto port = std::make_shared<ChokedPort>();
+    ControllerCore<2> core;
+    core.begin(port, 0.001);
+    Handle h = core.stop(0);
+    CHECK(core.wait({ h }, 1.0));
+    CHECK(h.result().status == Result::Status::Done);
+    CHECK(port->bytes.size() == 13);
+    CHECK(port->bytes.size() >= 2 && crc16(port->bytes.data(), port->bytes.size()) == 0); // crc over the whole frame
+    
+    auto broken = std::make_shared<ChokedPort>(true);
+    ControllerCore<2> dead;
+    dead.begin(broken, 0.001);
+    Handle lost = dead.stop(0);
+    CHECK(dead.wait({ lost }, 1.0));
+    CHECK(lost.result().status == Result::Status::WriteError);
+    CHECK(dead.getNumWriteErrors() == 1);
+    CHECK(dead.getNumWrites() == 0);
+}
+
+// frames are values : what goes out is what the buffer held when write*() was called
+static void testFrameValues()
+{
+    static_assert(sizeof(DirectDrive) == writeFrameSize(reg::DirectDrive::words), "no vtable or offsets in a frame");
+    
+    auto port = std::make_shared<ChokedPort>();
+    ControllerCore<2> core;
+    core.begin(port, 0.001);
+    core.setPosition(1, 1234);
+    Handle h = core.writePosition(0);
+    core.setPosition(1, 5678);
+    CHECK(core.wait({ h }, 1.0));
+    CHECK(port->bytes.size() == writeFrameSize(0x7B));
+    CHECK(port->bytes.size() > 15 && (decode<WriteField<1, true> >(port->bytes.data()) == 1234));
+    CHECK(crc16(port->bytes.data(), port->bytes.size()) == 0);
+    
+    Frame f = FrameCache::remoteIOs(CmdType::Stop, 1);
+    f.setID(2);
+    CHECK(f.getID() == 2 && crc16(f.data(), f.size()) == 0);
+    CHECK(FrameCache::remoteIOs(CmdType::Stop, 1).getID() == 1);
+}
+
+int main()
+{
+    testShortWrites();
+    testFrameValues();
+    
+    auto port = std::make_shared<PtyPort>();
+    if (!port->open())
+    {
+        std::printf("no pty, skipped\n");
+        return 0;
+    }
+    Drive drive;
+    CHECK(drive.open(port->getSlaveName()));
+    
+    ControllerCore<2> core;
+    CHECK(core.begin(port, 0.005));
+    
+    // request : decoded reply
+    Handle status = core.request(RequestType::Status, 1);
+    CHECK(core.wait({ status }, 1.0));
+    CHECK(status.result().status == Result::Status::Done);
+    CHECK(status.result().value == 0x2020);
+    CHECK(core.isReady(1));
+    
+    // write : resolved by its echo
+    Handle sel = core.data_no(3, 1);
+    CHECK(core.wait({ sel }, 1.0));
+    CHECK(sel.result().status == Result::Status::Done);
+    
+    // silent drive : the request and the write time out
+    Handle lost = core.request(RequestType::Position, 2);
+    Handle unechoed = core.data_no(3, 2);
+    CHECK(core.wait({ lost, unechoed }, 2.0));
+    CHECK(lost.result().status == Result::Status::Timeout);
+    CHECK(unechoed.result().status == Result::Status::Timeout);
+    CHECK(core.getNumTimeouts() == 1);
+    
+    // every frame went out whole
+    CHECK(core.getNumWriteErrors() == 0);
+    CHECK(drive.num_frames == core.getNumWrites());
+    
+    drive.close();
+    port->close();
+    if (failures) return 1;
+    std::printf("ok\n");
+    return 0;
+}